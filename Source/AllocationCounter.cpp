@@ -0,0 +1,53 @@
+#include "AllocationCounter.h"
+
+//the console target only, see AllocationCounter.h
+#if HARMONIZER_COMMAND_LINE_MAIN
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace
+{
+    thread_local bool countingThisThread = false;
+    std::atomic<int64_t> numAllocations { 0 };
+    std::atomic<int64_t> numFrees { 0 };
+
+    void* allocate (std::size_t size)
+    {
+        if (countingThisThread)
+            ++numAllocations;
+        if (void* memory = std::malloc (size > 0 ? size : 1))
+            return memory;
+        throw std::bad_alloc();
+    }
+
+    void release (void* memory) noexcept
+    {
+        if (memory != nullptr && countingThisThread)
+            ++numFrees;
+        std::free (memory);
+    }
+}
+
+//the aligned and nothrow forms end up in these or in their own aligned allocation, which is not counted
+void* operator new (std::size_t size) { return allocate (size); }
+void* operator new[] (std::size_t size) { return allocate (size); }
+void operator delete (void* memory) noexcept { release (memory); }
+void operator delete[] (void* memory) noexcept { release (memory); }
+void operator delete (void* memory, std::size_t) noexcept { release (memory); }
+void operator delete[] (void* memory, std::size_t) noexcept { release (memory); }
+
+bool AllocationCounter::isAvailable() { return true; }
+void AllocationCounter::setCountingThisThread (bool shouldCount) { countingThisThread = shouldCount; }
+int64_t AllocationCounter::getNumAllocations() { return numAllocations.load(); }
+int64_t AllocationCounter::getNumFrees() { return numFrees.load(); }
+
+#else
+
+bool AllocationCounter::isAvailable() { return false; }
+void AllocationCounter::setCountingThisThread (bool) {}
+int64_t AllocationCounter::getNumAllocations() { return 0; }
+int64_t AllocationCounter::getNumFrees() { return 0; }
+
+#endif
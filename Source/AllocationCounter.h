@@ -0,0 +1,28 @@
+/*
+  ==============================================================================
+
+    AllocationCounter.h
+    Author:  Sami S
+
+    Counts operator new and delete on the threads that ask for it, so a
+    harness can tell whether the audio thread allocated. The replacement
+    operators are only built into the console target
+    (HARMONIZER_COMMAND_LINE_MAIN=1). In the plugin every allocation of
+    the host would pay for the check, so there isAvailable() is false. Memory from malloc directly (HeapBlock,
+    say) is not seen.
+
+  ==============================================================================
+*/
+#pragma once
+
+#include <cstdint>
+
+struct AllocationCounter
+{
+    static bool isAvailable();
+    //the calling thread's allocations are counted from now on, or no longer
+    static void setCountingThisThread (bool shouldCount);
+    //on every counting thread since the process started
+    static int64_t getNumAllocations();
+    static int64_t getNumFrees();
+};
@@ -0,0 +1,96 @@
+/*
+  ==============================================================================
+
+    AmdfPitchDetector.h
+    Author:  Sami S
+
+    Cheap pitch tracker for instances where accuracy matters less than CPU,
+    such as backing vocals. It works on an 11 kHz copy of the input, which is
+    enough for vocal fundamentals. A zero crossing count rejects noisy
+    (unvoiced) windows before any lag is searched. The period comes from the
+    average magnitude difference function, normalised by its cumulative mean
+    like YIN's difference function. It needs no multiplies in the lag search
+    and a sixteenth of the lags x samples YIN needs at 44.1 kHz.
+
+  ==============================================================================
+*/
+#pragma once
+
+#include "PitchDetector.h"
+
+class AmdfPitchDetector : public PitchDetector
+{
+public:
+    void prepare (double sampleRate, int blockSize) override
+    {
+        prepareHistory (sampleRate, 11025.0, blockSize, minWindowSize);
+        amdf.assign (windowSize, 0.0f);
+
+        latest = { 0.0f, 0.0f };
+        hasNewSamples = false;
+    }
+
+    void pushSamples (const float* data, int numSamples) override
+    {
+        pushHistory (data, numSamples);
+        hasNewSamples = true;
+    }
+
+    PitchEstimate getPitch() override
+    {
+        if (hasNewSamples) {
+            latest = analyse();
+            hasNewSamples = false;
+        }
+        return latest;
+    }
+
+    //absolute differences are roughly the square root of YIN's squared ones
+    void setThreshold (float newThreshold) override
+    {
+        threshold = std::sqrt (newThreshold);
+    }
+
+private:
+    enum { minWindowSize = 32 };
+
+    PitchEstimate analyse()
+    {
+        const float* x = history.data();
+
+        //more crossings than one every few samples is noise, not a voice
+        int numCrossings = 0;
+        for (int i = 1; i < 2 * windowSize; ++i)
+            numCrossings += (x[i - 1] < 0.0f) != (x[i] < 0.0f);
+        if (numCrossings == 0 || numCrossings > 2 * windowSize / minSamplesPerCrossing)
+            return { 0.0f, 0.0f };
+
+        float sum = 0.0f;
+        amdf[0] = 1.0f;
+        for (int tau = 1; tau < windowSize; ++tau) {
+            float difference = 0.0f;
+            for (int i = 0; i < windowSize; ++i)
+                difference += std::abs (x[i] - x[i + tau]);
+
+            sum += difference;
+            amdf[tau] = sum != 0.0f ? difference * (float)tau / sum : 1.0f;
+
+            //first dip under the threshold, once the next lag shows it is a minimum
+            const int period = tau - 1;
+            if (period > 1 && amdf[period] < threshold && amdf[period] <= amdf[tau]) {
+                const float refined = parabolicVertex (amdf.data(), period, tau + 1);
+                return { (float)(decimatedRate / (double)refined), std::max (0.0f, 1.0f - amdf[period]) };
+            }
+        }
+
+        return { 0.0f, 0.0f };
+    }
+
+    enum { minSamplesPerCrossing = 2 };
+
+    std::vector<float> amdf;
+
+    float threshold = 0.3f;
+    PitchEstimate latest { 0.0f, 0.0f };
+    bool hasNewSamples = false;
+};
@@ -0,0 +1,305 @@
+/*
+  ==============================================================================
+
+    AnalysisCache.h
+    Author:  Sami S
+
+    Analysis of an offline render kept on disk, so re-rendering the same
+    input with a different harmony only runs the synthesis. A recording
+    stores, for every frame and channel, the block's pitch estimate and the
+    magnitude and phase of the bins up to fftSize / 2. The instantaneous
+    frequency follows from consecutive phases exactly as in a live render.
+    A replay memory-maps the file and reads frames straight from it.
+
+    Files are only valid for the layout they were recorded with (sample
+    rate, fft size, hop, window, channels and where the render started on
+    the timeline), and for the audio that was analysed: a recording ends
+    with a hash of the input of every hop, and a replay stops at the first
+    hop whose input hashes differently (the audio was edited, or the file
+    belongs to someone else) so the caller can analyse live from there.
+    Files are named after the instance that wrote them, an id kept in the
+    plugin state, so tracks with the same name do not share one. They are
+    written in native byte order, as a local cache rather than an exchange
+    format.
+
+  ==============================================================================
+*/
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "HarmonizerEngine.h"
+
+class AnalysisCache : public HarmonizerEngine::AnalysisStore
+{
+public:
+    struct Layout
+    {
+        double sampleRate = 0.0;
+        int fftSize = 0;
+        int hopSize = 0;
+        int numChannels = 0;
+        int windowType = 0;
+        //where the render started and how far it was into the current hop
+        int64 startSample = 0;
+        int hopPhase = 0;
+
+        //frames of both layouts line up and have the same size
+        bool hasSameFrames (const Layout& other) const
+        {
+            return sampleRate == other.sampleRate && fftSize == other.fftSize && hopSize == other.hopSize
+                && numChannels == other.numChannels && windowType == other.windowType;
+        }
+    };
+
+    ~AnalysisCache()
+    {
+        close();
+    }
+
+    //one file per instance and analysis size in the temp folder, the track name only makes it readable
+    static File getFileFor (const String& trackName, const String& instanceID, const Layout& layout)
+    {
+        const String name = File::createLegalFileName (trackName.isEmpty() ? String ("Untitled") : trackName);
+        return File::getSpecialLocation (File::tempDirectory)
+                   .getChildFile ("HarmonizerAnalysis")
+                   .getChildFile (name + "_" + File::createLegalFileName (instanceID) + "_" + String (layout.fftSize)
+                                  + "_" + String (layout.hopSize) + ".hac");
+    }
+
+    bool startRecording (const File& file, const Layout& newLayout)
+    {
+        close();
+
+        file.getParentDirectory().createDirectory();
+        file.deleteFile();
+        output = std::make_unique<FileOutputStream> (file);
+        if (output->failedToOpen()) {
+            output.reset();
+            return false;
+        }
+
+        layout = newLayout;
+        numBins = layout.fftSize / 2 + 1;
+        numFrames = 0;
+        resetFingerprint();
+        fingerprints.clearQuick();
+        writeHeader();
+        return true;
+    }
+
+    //frames can come in any order, every channel of a frame has its own record
+    void writeFrame (int64_t frame, int channel, const float* magnitudes, const float* phases, PitchEstimate estimate) override
+    {
+        const FrameHeader frameHeader { estimate.frequency, estimate.confidence };
+        output->setPosition (getFrameOffset (frame, channel));
+        output->write (&frameHeader, sizeof (frameHeader));
+        output->write (magnitudes, (size_t)numBins * sizeof (float));
+        output->write (phases, (size_t)numBins * sizeof (float));
+
+        numFrames = jmax (numFrames, (int64)frame + 1);
+    }
+
+    bool openForReplay (const File& file, const Layout& expectedLayout)
+    {
+        close();
+
+        mapped = std::make_unique<MemoryMappedFile> (file, MemoryMappedFile::readOnly);
+        if (mapped->getData() == nullptr || mapped->getSize() < sizeof (FileHeader)) {
+            mapped.reset();
+            return false;
+        }
+
+        FileHeader header;
+        std::memcpy (&header, mapped->getData(), sizeof (header));
+
+        const bool matches = std::memcmp (header.magic, fileMagic, sizeof (header.magic)) == 0
+                          && header.version == fileVersion
+                          && header.sampleRate == expectedLayout.sampleRate
+                          && header.fftSize == expectedLayout.fftSize
+                          && header.hopSize == expectedLayout.hopSize
+                          && header.numChannels == expectedLayout.numChannels
+                          && header.windowType == expectedLayout.windowType
+                          && header.startSample == expectedLayout.startSample
+                          && header.hopPhase == expectedLayout.hopPhase
+                          && header.numBins == expectedLayout.fftSize / 2 + 1;
+        if (!matches) {
+            mapped.reset();
+            return false;
+        }
+
+        layout = expectedLayout;
+        numBins = header.numBins;
+
+        //a recording that was cut short never got its frame count or its hashes written, the first hop then mismatches
+        const int64 frameSize = (int64)getFrameSize() * layout.numChannels;
+        numFrames = jmin (header.numFrames, ((int64)mapped->getSize() - (int64)sizeof (FileHeader)) / frameSize);
+
+        resetFingerprint();
+        fingerprints.clearQuick();
+        const int64 fingerprintOffset = getFrameOffset (numFrames, 0);
+        const int64 numFingerprints = jmin (header.numFingerprints, ((int64)mapped->getSize() - fingerprintOffset) / (int64)sizeof (uint32));
+        if (numFrames == header.numFrames && numFingerprints > 0) {
+            fingerprints.resize ((int)numFingerprints);
+            std::memcpy (fingerprints.getRawDataPointer(), static_cast<const char*> (mapped->getData()) + fingerprintOffset,
+                         (size_t)numFingerprints * sizeof (uint32));
+        }
+        return true;
+    }
+
+    //every block before it is processed: hashes the input hop by hop, recording the hashes or checking them
+    //against the recording's. numChannels of the main input, not the analysis channels
+    void fingerprintInput (const float* const* inputs, int numChannels, int numSamples)
+    {
+        if (!isRecording() && !isReplaying())
+            return;
+
+        for (int sample = 0; sample < numSamples; ++sample) {
+            for (int channel = 0; channel < numChannels; ++channel) {
+                uint32 bits;
+                std::memcpy (&bits, inputs[channel] + sample, sizeof (bits));
+                //fnv-1a over the sample bits
+                fingerprint = (fingerprint ^ bits) * 16777619u;
+            }
+
+            if (++fingerprintSamples == layout.hopSize)
+                finishHop();
+        }
+    }
+
+    //a replay whose input differs from the recording's from some hop on. frames are still read until the caller closes
+    bool hasMismatch() const { return mismatch; }
+
+    //fills the fftSize bins from the stored half spectrum. magnitudes and phases can be null for the pitch only
+    bool readFrame (int64_t frame, int channel, float* magnitudes, float* phases, PitchEstimate* estimate) const override
+    {
+        if (mapped == nullptr || (int64)frame >= numFrames)
+            return false;
+
+        const char* data = static_cast<const char*> (mapped->getData()) + getFrameOffset (frame, channel);
+
+        FrameHeader frameHeader;
+        std::memcpy (&frameHeader, data, sizeof (frameHeader));
+        if (estimate != nullptr)
+            *estimate = { frameHeader.frequency, frameHeader.confidence };
+
+        if (magnitudes != nullptr && phases != nullptr) {
+            std::memcpy (magnitudes, data + sizeof (frameHeader), (size_t)numBins * sizeof (float));
+            std::memcpy (phases, data + sizeof (frameHeader) + (size_t)numBins * sizeof (float), (size_t)numBins * sizeof (float));
+
+            //the upper half of a real signal's spectrum mirrors the lower one
+            for (int bin = numBins; bin < layout.fftSize; ++bin) {
+                magnitudes[bin] = magnitudes[layout.fftSize - bin];
+                phases[bin] = -phases[layout.fftSize - bin];
+            }
+        }
+
+        return true;
+    }
+
+    void close()
+    {
+        if (output != nullptr) {
+            output->setPosition (getFrameOffset (numFrames, 0));
+            output->write (fingerprints.begin(), (size_t)fingerprints.size() * sizeof (uint32));
+            writeHeader();
+            output->flush();
+            output.reset();
+        }
+
+        mapped.reset();
+    }
+
+    bool isRecording() const override { return output != nullptr; }
+    bool isReplaying() const { return mapped != nullptr; }
+    const Layout& getLayout() const { return layout; }
+
+private:
+    struct FileHeader
+    {
+        char magic[4];
+        int32 version;
+        double sampleRate;
+        int32 fftSize;
+        int32 hopSize;
+        int32 numChannels;
+        int32 windowType;
+        int64 startSample;
+        int32 hopPhase;
+        int32 numBins;
+        int64 numFrames;
+        //hashes of the hops' input, after the last frame
+        int64 numFingerprints;
+    };
+
+    struct FrameHeader
+    {
+        float frequency;
+        float confidence;
+    };
+
+    void writeHeader()
+    {
+        FileHeader header;
+        std::memcpy (header.magic, fileMagic, sizeof (header.magic));
+        header.version = fileVersion;
+        header.sampleRate = layout.sampleRate;
+        header.fftSize = layout.fftSize;
+        header.hopSize = layout.hopSize;
+        header.numChannels = layout.numChannels;
+        header.windowType = layout.windowType;
+        header.startSample = layout.startSample;
+        header.hopPhase = layout.hopPhase;
+        header.numBins = numBins;
+        header.numFrames = numFrames;
+        header.numFingerprints = fingerprints.size();
+
+        output->setPosition (0);
+        output->write (&header, sizeof (header));
+    }
+
+    int getFrameSize() const
+    {
+        return (int)sizeof (FrameHeader) + 2 * numBins * (int)sizeof (float);
+    }
+
+    int64 getFrameOffset (int64 frame, int channel) const
+    {
+        return (int64)sizeof (FileHeader) + (frame * layout.numChannels + channel) * (int64)getFrameSize();
+    }
+
+    void resetFingerprint()
+    {
+        fingerprint = 2166136261u;
+        fingerprintSamples = 0;
+        fingerprintIndex = 0;
+        mismatch = false;
+    }
+
+    void finishHop()
+    {
+        if (isRecording())
+            fingerprints.add (fingerprint);
+        else if (fingerprintIndex >= fingerprints.size() || fingerprints[fingerprintIndex] != fingerprint)
+            mismatch = true;
+
+        ++fingerprintIndex;
+        fingerprint = 2166136261u;
+        fingerprintSamples = 0;
+    }
+
+    static constexpr const char* fileMagic = "HAC1";
+    enum { fileVersion = 2 };
+
+    Layout layout;
+    int numBins = 0;
+    int64 numFrames = 0;
+
+    Array<uint32> fingerprints;
+    uint32 fingerprint = 2166136261u;
+    int fingerprintSamples = 0;
+    int fingerprintIndex = 0;
+    bool mismatch = false;
+
+    std::unique_ptr<FileOutputStream> output;
+    std::unique_ptr<MemoryMappedFile> mapped;
+};
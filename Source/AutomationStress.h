@@ -0,0 +1,221 @@
+/*
+  ==============================================================================
+
+    AutomationStress.h
+    Author:  Sami S
+
+    What automation costs the audio thread. A simulated host callback runs
+    processBlock at the block period on a thread of its own, holding a note,
+    while the calling thread sets the fft size, hop, window and threshold
+    params through the apvts with random values, the way automation lanes
+    arrive from a host. The fft size, hop and window rebuild the engine under
+    the processor's lock, so the callback can end up waiting for them.
+
+    Reports every param on its own and all of them together: the worst and
+    the p99.9 callback time against the period, the callbacks that missed
+    it, the worst and the p99.9 wait for the lock, and the allocations and
+    frees on the audio thread. The random values come from a fixed seed, so
+    runs are repeatable on the same machine.
+
+    The console target prints the table with harmonizer --stress, see
+    CommandLineMain.cpp. Only that target counts allocations, see
+    AllocationCounter.
+
+  ==============================================================================
+*/
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "AllocationCounter.h"
+#include "BenchmarkHelpers.h"
+#include "PluginProcessor.h"
+
+struct AutomationStress
+{
+    struct Options
+    {
+        double sampleRate = 48000.0;
+        int blockSize = 512;
+        //per row of the report
+        double seconds = 5.0;
+        //between two param changes, 0 for back to back
+        double automationIntervalMs = 2.0;
+        StringArray paramIDs { "fftsize", "hopsize", "windowtype", "threshold" };
+        int64 seed = 1;
+    };
+
+    using InstanceFactory = std::function<HarmonizerAudioProcessor*()>;
+
+    static String run (const InstanceFactory& createInstance)
+    {
+        return run (createInstance, Options());
+    }
+
+    static String run (const InstanceFactory& createInstance, const Options& options)
+    {
+        const double period = options.blockSize / options.sampleRate;
+        String report = "Automation stress: " + String (options.blockSize) + " samples at " + String (options.sampleRate)
+                      + " Hz, callback period " + String (period * 1000.0, 2) + " ms, a change every "
+                      + String (options.automationIntervalMs, 1) + " ms for " + String (options.seconds, 1) + " s\n";
+        report << String ("param").paddedRight (' ', 12) << String ("changes").paddedRight (' ', 9)
+               << String ("max ms").paddedRight (' ', 9) << String ("p99.9 ms").paddedRight (' ', 10)
+               << String ("missed").paddedRight (' ', 8) << String ("lock max ms").paddedRight (' ', 13)
+               << String ("lock p99.9 ms").paddedRight (' ', 15) << String ("allocs").paddedRight (' ', 8) << "frees\n";
+
+        StringArray rows (options.paramIDs);
+        rows.add ("all");
+
+        for (auto& row : rows) {
+            std::unique_ptr<HarmonizerAudioProcessor> processor (createInstance());
+            const Run result = runStress (*processor, options, row == "all" ? options.paramIDs : StringArray (row));
+            processor->releaseResources();
+
+            const bool counted = AllocationCounter::isAvailable();
+            report << row.paddedRight (' ', 12) << String (result.numChanges).paddedRight (' ', 9)
+                   << String (result.worst * 1000.0, 3).paddedRight (' ', 9) << String (result.p999 * 1000.0, 3).paddedRight (' ', 10)
+                   << String (result.numMissed).paddedRight (' ', 8) << String (result.worstLockWait * 1000.0, 3).paddedRight (' ', 13)
+                   << String (result.p999LockWait * 1000.0, 3).paddedRight (' ', 15)
+                   << (counted ? String (result.numAllocations) : String ("n/a")).paddedRight (' ', 8)
+                   << (counted ? String (result.numFrees) : String ("n/a")) << "\n";
+        }
+
+        return report;
+    }
+
+private:
+    struct Run
+    {
+        int numChanges = 0;
+        double worst = 0.0;
+        double p999 = 0.0;
+        int numMissed = 0;
+        double worstLockWait = 0.0;
+        double p999LockWait = 0.0;
+        int64 numAllocations = 0;
+        int64 numFrees = 0;
+    };
+
+    //the host's audio thread: a callback every period, timed from entering processBlock to leaving it
+    class AudioThread : public Thread
+    {
+    public:
+        AudioThread (HarmonizerAudioProcessor& owner, const Options& options)
+            : Thread ("Automation stress audio"), processor (owner), buffer (2, options.blockSize),
+              signal (BenchmarkHelpers::createSungVowel (1, options.sampleRate)), periodTicks (Time::secondsToHighResolutionTicks (options.blockSize / options.sampleRate))
+        {
+            const int maxCallbacks = (int)(options.seconds / (options.blockSize / options.sampleRate)) + 1000;
+            callbackTimes.ensureStorageAllocated (maxCallbacks);
+            lockWaits.ensureStorageAllocated (maxCallbacks);
+            midi.ensureSize (256);
+            midi.addEvent (MidiMessage::noteOn (1, 64, (uint8)100), 0);
+        }
+
+        void run() override
+        {
+            //the flush to zero mode is per thread
+            ScopedNoDenormals noDenormals;
+            AllocationCounter::setCountingThisThread (true);
+            const int64 firstAllocations = AllocationCounter::getNumAllocations();
+            const int64 firstFrees = AllocationCounter::getNumFrees();
+
+            int64 deadline = Time::getHighResolutionTicks();
+            int position = 0;
+            while (!threadShouldExit() && callbackTimes.size() < callbackTimes.getNumAllocated()) {
+                //the host calls back once a period, sleeping through most of the wait
+                deadline += periodTicks;
+                while (Time::getHighResolutionTicks() < deadline) {
+                    if (Time::highResolutionTicksToSeconds (deadline - Time::getHighResolutionTicks()) > 0.002)
+                        Thread::sleep (1);
+                    else
+                        Thread::yield();
+                }
+
+                for (int channel = 0; channel < 2; ++channel)
+                    buffer.copyFrom (channel, 0, signal, 0, position, buffer.getNumSamples());
+                position = (position + buffer.getNumSamples()) % (signal.getNumSamples() - buffer.getNumSamples());
+
+                const int64 startTicks = Time::getHighResolutionTicks();
+                processor.processBlock (buffer, midi);
+                const int64 endTicks = Time::getHighResolutionTicks();
+                //the note stays held from the first callback on
+                midi.clear();
+
+                callbackTimes.add (Time::highResolutionTicksToSeconds (endTicks - startTicks));
+                lockWaits.add (Time::highResolutionTicksToSeconds (processor.getLastLockWaitTicks()));
+
+                //a late callback does not make the next ones early
+                deadline = jmax (deadline, endTicks - periodTicks);
+            }
+
+            numAllocations = AllocationCounter::getNumAllocations() - firstAllocations;
+            numFrees = AllocationCounter::getNumFrees() - firstFrees;
+            AllocationCounter::setCountingThisThread (false);
+        }
+
+        Array<double> callbackTimes;
+        Array<double> lockWaits;
+        int64 numAllocations = 0;
+        int64 numFrees = 0;
+
+    private:
+        HarmonizerAudioProcessor& processor;
+        AudioBuffer<float> buffer;
+        AudioBuffer<float> signal;
+        MidiBuffer midi;
+        const int64 periodTicks;
+    };
+
+    static Run runStress (HarmonizerAudioProcessor& processor, const Options& options, const StringArray& paramIDs)
+    {
+        //the rebuilds are what is measured, the governor dropping to smaller ffts would hide them
+        BenchmarkHelpers::setParameter (processor, "cpugovernor", 0.0f);
+        processor.setPlayConfigDetails (2, 2, options.sampleRate, options.blockSize);
+        processor.setNonRealtime (false);
+        processor.prepareToPlay (options.sampleRate, options.blockSize);
+
+        Array<AudioProcessorParameter*> automated;
+        for (auto* parameter : processor.getParameters())
+            if (auto* withID = dynamic_cast<AudioProcessorParameterWithID*> (parameter))
+                if (paramIDs.contains (withID->paramID))
+                    automated.add (withID);
+
+        AudioThread audioThread (processor, options);
+        audioThread.startThread (Thread::Priority::highest);
+
+        //the calling thread is the automation: a param at a time, in turn, to a random value
+        Random random (options.seed);
+        Run result;
+        const int64 endTicks = Time::getHighResolutionTicks() + Time::secondsToHighResolutionTicks (options.seconds);
+        while (Time::getHighResolutionTicks() < endTicks && !automated.isEmpty()) {
+            automated[result.numChanges % automated.size()]->setValueNotifyingHost (random.nextFloat());
+            ++result.numChanges;
+
+            if (options.automationIntervalMs > 0.0)
+                Thread::sleep (jmax (1, roundToInt (options.automationIntervalMs)));
+        }
+        if (automated.isEmpty())
+            Thread::sleep (roundToInt (options.seconds * 1000.0));
+
+        audioThread.stopThread (10000);
+
+        Array<double>& callbackTimes = audioThread.callbackTimes;
+        Array<double>& lockWaits = audioThread.lockWaits;
+        const double period = options.blockSize / options.sampleRate;
+        for (double time : callbackTimes)
+            if (time > period)
+                ++result.numMissed;
+
+        if (!callbackTimes.isEmpty()) {
+            callbackTimes.sort();
+            lockWaits.sort();
+            const int p999Index = jmin (callbackTimes.size() - 1, (int)(callbackTimes.size() * 0.999));
+            result.worst = callbackTimes.getLast();
+            result.p999 = callbackTimes[p999Index];
+            result.worstLockWait = lockWaits.getLast();
+            result.p999LockWait = lockWaits[p999Index];
+        }
+        result.numAllocations = audioThread.numAllocations;
+        result.numFrees = audioThread.numFrees;
+        return result;
+    }
+};
@@ -0,0 +1,46 @@
+/*
+  ==============================================================================
+
+    BenchmarkHelpers.h
+    Author:  Sami S
+
+    What the benchmarks and the kernel tuning share: the test signal they
+    drive the vocoder with, and setting a param of a processor by its ID
+    the way a host or a restored state would.
+
+  ==============================================================================
+*/
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+
+struct BenchmarkHelpers
+{
+    //one second of a sung /a/ around 200 Hz, twelve harmonics falling off with their number, the same in every channel.
+    //voiced and in the tracker's range, so the vocoder shifts rather than passing through
+    static AudioBuffer<float> createSungVowel (int numChannels, double sampleRate)
+    {
+        AudioBuffer<float> samples (numChannels, (int)sampleRate);
+        float* data = samples.getWritePointer (0);
+        for (int sample = 0; sample < samples.getNumSamples(); ++sample) {
+            const double phase = MathConstants<double>::twoPi * 200.0 * sample / sampleRate;
+            double value = 0.0;
+            for (int harmonic = 1; harmonic <= 12; ++harmonic)
+                value += std::sin (harmonic * phase) / harmonic;
+            data[sample] = (float)(0.25 * value);
+        }
+
+        for (int channel = 1; channel < numChannels; ++channel)
+            samples.copyFrom (channel, 0, samples, 0, 0, samples.getNumSamples());
+        return samples;
+    }
+
+    //value in the param's own range, the host is notified like for automation
+    static void setParameter (AudioProcessor& processor, const String& paramID, float value)
+    {
+        for (auto* parameter : processor.getParameters())
+            if (auto* withID = dynamic_cast<AudioProcessorParameterWithID*> (parameter))
+                if (withID->paramID == paramID)
+                    withID->setValueNotifyingHost (withID->convertTo0to1 (value));
+    }
+};
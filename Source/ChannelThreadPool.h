@@ -0,0 +1,150 @@
+/*
+  ==============================================================================
+
+    ChannelThreadPool.h
+    Author:  Sami S
+
+    Runs the channels of a surround block on worker threads, for the
+    engine's parallel channels. The audio thread signals the workers, runs
+    channels itself like they do and waits for the last one to finish:
+    a short spin on the count of finished channels, then on the event the
+    worker finishing the last one signals. Idle workers sleep on their own
+    event. Channels are claimed from a counter that also carries the number
+    of the run, so a worker waking late from the previous run cannot take
+    one of the next. Without workers everything runs on the audio thread.
+
+    Threads are started and stopped by setNumWorkers only, which may block
+    for a second; the owner calls it outside any lock the audio thread
+    takes and picks how many of them run with setNumActiveWorkers.
+
+  ==============================================================================
+*/
+#pragma once
+
+#include <atomic>
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "HarmonizerEngine.h"
+
+class ChannelThreadPool : public HarmonizerEngine::ChannelExecutor
+{
+public:
+    ChannelThreadPool() = default;
+
+    ~ChannelThreadPool()
+    {
+        setNumWorkers (0);
+    }
+
+    //not realtime safe, starts or stops threads. never while run is in progress
+    void setNumWorkers (int numWorkers)
+    {
+        numActiveWorkers = jmin (numActiveWorkers, numWorkers);
+        if (numWorkers == workers.size())
+            return;
+
+        for (auto* worker : workers)
+            worker->signalThreadShouldExit();
+        for (auto* worker : workers) {
+            worker->start.signal();
+            worker->stopThread (1000);
+        }
+        workers.clear();
+
+        for (int index = 0; index < numWorkers; ++index) {
+            workers.add (new Worker (*this));
+            workers.getLast()->startThread (Thread::Priority::highest);
+        }
+    }
+
+    int getNumWorkers() const
+    {
+        return workers.size();
+    }
+
+    //realtime safe, how many of the started workers the next runs wake. never while run is in progress
+    void setNumActiveWorkers (int numWorkers)
+    {
+        numActiveWorkers = jlimit (0, workers.size(), numWorkers);
+    }
+
+    //audio thread
+    void run (int numTasks, Task task, void* context) override
+    {
+        currentTask = task;
+        currentContext = context;
+        done = 0;
+
+        //run number in the upper half, the number of tasks and the next one to claim in the lower quarters
+        const uint64 runNumber = (claims.load() >> 32) + 1;
+        claims = (runNumber << 32) | ((uint64)numTasks << 16);
+
+        for (int index = 0; index < numActiveWorkers; ++index)
+            workers.getUnchecked (index)->start.signal();
+        runTasks();
+
+        //the others are rarely more than a channel behind, which a short spin covers without a wakeup. a signal
+        //left over from a run that finished while spinning only goes round once more
+        for (int spin = 0; spin < maxSpins && done.load() < numTasks; ++spin) {}
+        while (done.load() < numTasks)
+            finished.wait (-1.0);
+    }
+
+private:
+    class Worker : public Thread
+    {
+    public:
+        explicit Worker (ChannelThreadPool& owner) : Thread ("Harmonizer channel worker"), pool (owner)
+        {
+        }
+
+        void run() override
+        {
+            //the flush to zero mode is per thread
+            ScopedNoDenormals noDenormals;
+
+            //setNumWorkers signals start after asking the thread to exit
+            while (!threadShouldExit()) {
+                start.wait (-1.0);
+                if (!threadShouldExit())
+                    pool.runTasks();
+            }
+        }
+
+        WaitableEvent start;
+
+    private:
+        ChannelThreadPool& pool;
+    };
+
+    void runTasks()
+    {
+        uint64 current = claims.load();
+        for (;;) {
+            const int numTasks = (int)((current >> 16) & 0xffff);
+            const int index = (int)(current & 0xffff);
+            if (index >= numTasks)
+                return;
+
+            //fails and reloads when another thread claimed first or a new run started
+            if (claims.compare_exchange_weak (current, current + 1)) {
+                currentTask (currentContext, index);
+                if (++done == numTasks)
+                    finished.signal();
+                current = claims.load();
+            }
+        }
+    }
+
+    enum { maxSpins = 4096 };
+
+    OwnedArray<Worker> workers;
+    int numActiveWorkers = 0;
+    WaitableEvent finished;
+
+    Task currentTask = nullptr;
+    void* currentContext = nullptr;
+    std::atomic<uint64> claims { 0 };
+    std::atomic<int> done { 0 };
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (ChannelThreadPool)
+};
@@ -0,0 +1,66 @@
+#include "PcmStream.h"
+#include "AutomationStress.h"
+#include "FFTBenchmark.h"
+#include "KernelWisdom.h"
+#include "RegressionHarness.h"
+#include "SessionBenchmark.h"
+#include "StartupBenchmark.h"
+#include "PluginProcessor.h"
+
+//the plugin builds this file too, so the command line front ends are compiled with every change to the
+//processor. a console target defines HARMONIZER_COMMAND_LINE_MAIN=1 and gets the entry point as well
+#if HARMONIZER_COMMAND_LINE_MAIN
+
+//harmonizer --tune-kernels [--seconds 0.05] times the kernels of this machine, see KernelWisdom.
+//harmonizer --benchmark prints the fft backends' timings, see FFTBenchmark.
+//harmonizer --session-benchmark drives sessions of up to 100 instances, see SessionBenchmark.
+//harmonizer --startup-benchmark loads them, see StartupBenchmark. one tool per process, for clean peaks.
+//harmonizer --stress automates params against a simulated host callback, see AutomationStress.
+//harmonizer --regression [...] checks the vocoder still sounds the same and exits with 1 when it does not,
+//see RegressionHarness. anything else streams stdin to stdout, see PcmStream
+int main (int argc, char* argv[])
+{
+    //the apvts and the editor-less processor still expect juce to be initialised
+    ScopedJuceInitialiser_GUI juceInitialiser;
+
+    //the option takes the place of the program name, so the tuner sees only its own
+    if (argc > 1 && String (argv[1]) == "--tune-kernels")
+        return KernelWisdom::tuneFromCommandLine (argc - 1, argv + 1);
+
+    if (argc > 1 && String (argv[1]) == "--benchmark") {
+        std::unique_ptr<HarmonizerAudioProcessor> processor (new HarmonizerAudioProcessor());
+        std::fputs (FFTBenchmark::run (processor->fftSizeItemsUI).toRawUTF8(), stdout);
+        return 0;
+    }
+
+    if (argc > 1 && String (argv[1]) == "--session-benchmark") {
+        std::fputs (SessionBenchmark::run ([] { return new HarmonizerAudioProcessor(); }).toRawUTF8(), stdout);
+        return 0;
+    }
+
+    if (argc > 1 && String (argv[1]) == "--startup-benchmark") {
+        std::fputs (StartupBenchmark::run ([] { return new HarmonizerAudioProcessor(); }).toRawUTF8(), stdout);
+        return 0;
+    }
+
+    if (argc > 1 && String (argv[1]) == "--stress") {
+        std::fputs (AutomationStress::run ([] { return new HarmonizerAudioProcessor(); }).toRawUTF8(), stdout);
+        return 0;
+    }
+
+    //the vendored fft has to sound like the juce one it replaces
+    if (argc > 1 && String (argv[1]) == "--regression") {
+        auto createFFT = [](FFTEngine::Backend backend) {
+            return [backend](int order, std::shared_ptr<const StockhamFFT::Twiddles> twiddles) {
+                return FFTEngine::create (order, backend, std::move (twiddles));
+            };
+        };
+        return RegressionHarness::runFromCommandLine (argc - 1, argv + 1, createFFT (FFTEngine::backendJuce),
+                                                      createFFT (FFTEngine::backendVendored));
+    }
+
+    std::unique_ptr<HarmonizerAudioProcessor> processor (new HarmonizerAudioProcessor());
+    return PcmStream::runFromCommandLine (*processor, argc, argv);
+}
+
+#endif
@@ -0,0 +1,96 @@
+/*
+  ==============================================================================
+
+    FFTBenchmark.h
+    Author:  Sami S
+
+    Times every FFT backend on the vocoder's transform (complex forward plus
+    inverse) and on the pitch tracker's (real forward plus inverse), for
+    each fft size the plugin offers. The console target prints the report
+    with harmonizer --benchmark, see CommandLineMain.cpp.
+
+  ==============================================================================
+*/
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "JuceFFTEngine.h"
+
+struct FFTBenchmark
+{
+    //microseconds per forward plus inverse pair, one line per size
+    static String run (const StringArray& fftSizes, double secondsPerCase = 0.05)
+    {
+        String report = "FFT benchmark (us per forward + inverse)\n";
+        report << String ("size").paddedRight (' ', 8);
+        for (int backend = 0; backend < FFTEngine::numBackends; ++backend) {
+            const String name = FFTEngine::getBackendName ((FFTEngine::Backend)backend);
+            report << (name + " complex").paddedRight (' ', 32) << (name + " real").paddedRight (' ', 32);
+        }
+        report << "\n";
+
+        for (const auto& item : fftSizes) {
+            const int order = (int)std::log2 (item.getIntValue());
+            report << String (1 << order).paddedRight (' ', 8);
+
+            for (int backend = 0; backend < FFTEngine::numBackends; ++backend) {
+                auto engine = FFTEngine::create (order, (FFTEngine::Backend)backend);
+                report << String (timeComplex (*engine, secondsPerCase), 3).paddedRight (' ', 32)
+                       << String (timeReal (*engine, secondsPerCase), 3).paddedRight (' ', 32);
+            }
+            report << "\n";
+        }
+
+        return report;
+    }
+
+    //also used by KernelWisdom
+    static double timeComplex (FFTEngine& engine, double seconds)
+    {
+        const int size = engine.getSize();
+        HeapBlock<dsp::Complex<float>> timeDomain (size), frequencyDomain (size);
+        Random random (1);
+        for (int index = 0; index < size; ++index)
+            timeDomain[index] = { random.nextFloat() * 2.0f - 1.0f, 0.0f };
+
+        return timePairs (seconds, [&] {
+            engine.perform (timeDomain, frequencyDomain, false);
+            engine.perform (frequencyDomain, timeDomain, true);
+        });
+    }
+
+    static double timeReal (FFTEngine& engine, double seconds)
+    {
+        const int size = engine.getSize();
+        HeapBlock<float> data (2 * size, true);
+        Random random (1);
+        for (int index = 0; index < size; ++index)
+            data[index] = random.nextFloat() * 2.0f - 1.0f;
+
+        return timePairs (seconds, [&] {
+            engine.performRealOnlyForwardTransform (data);
+            engine.performRealOnlyInverseTransform (data);
+        });
+    }
+
+    //runs batches until the time is up, after one warm-up batch
+    template <typename PairFunction>
+    static double timePairs (double seconds, PairFunction&& pair)
+    {
+        const int batch = 16;
+        for (int i = 0; i < batch; ++i)
+            pair();
+
+        int64 numPairs = 0;
+        const double start = Time::getMillisecondCounterHiRes();
+        double elapsed = 0.0;
+        while (elapsed < seconds * 1000.0) {
+            for (int i = 0; i < batch; ++i)
+                pair();
+            numPairs += batch;
+            elapsed = Time::getMillisecondCounterHiRes() - start;
+        }
+
+        return elapsed * 1000.0 / (double)numPairs;
+    }
+};
@@ -0,0 +1,90 @@
+/*
+  ==============================================================================
+
+    FFTEngine.h
+    Author:  Sami S
+
+    FFT used by the vocoder and the pitch trackers, so the backend can be
+    swapped without touching them. juce::dsp::FFT is fast where JUCE finds
+    IPP or vDSP, elsewhere its fallback is slow and the in-tree StockhamFFT
+    does better. This header is plain C++ and only has the vendored
+    backend, so the DSP core builds without JUCE. JuceFFTEngine.h adds the
+    juce backend and create(), which picks the default one.
+
+  ==============================================================================
+*/
+#pragma once
+
+#include <complex>
+#include <memory>
+#include "StockhamFFT.h"
+
+class FFTEngine
+{
+public:
+    enum Backend {
+        backendJuce = 0,
+        backendVendored,
+        numBackends,
+    };
+
+    virtual ~FFTEngine() = default;
+
+    int getSize() const noexcept { return size; }
+
+    //same contracts as juce::dsp::FFT, inverse transforms are scaled by 1 / size
+    virtual void perform (const std::complex<float>* input, std::complex<float>* output, bool inverse) = 0;
+    virtual void performRealOnlyForwardTransform (float* data) = 0;
+    virtual void performRealOnlyInverseTransform (float* data) = 0;
+
+    static const char* getBackendName (Backend backend)
+    {
+        return backend == backendVendored ? "Stockham (vendored)" : "juce::dsp::FFT";
+    }
+
+    //defined in JuceFFTEngine.h
+    static Backend getDefaultBackend();
+
+    //not realtime safe, allocates the plan. the vendored backend can reuse the twiddles of another instance.
+    //defined in JuceFFTEngine.h, code without JUCE creates a VendoredFFTEngine
+    static std::unique_ptr<FFTEngine> create (int order, Backend backend = getDefaultBackend(),
+                                              std::shared_ptr<const StockhamFFT::Twiddles> twiddles = nullptr);
+
+protected:
+    explicit FFTEngine (int order) : size (1 << order)
+    {
+    }
+
+    const int size;
+};
+
+class VendoredFFTEngine : public FFTEngine
+{
+public:
+    explicit VendoredFFTEngine (int order) : FFTEngine (order), fft (order)
+    {
+    }
+
+    explicit VendoredFFTEngine (std::shared_ptr<const StockhamFFT::Twiddles> twiddles)
+        : FFTEngine (twiddles->order), fft (twiddles)
+    {
+    }
+
+    void perform (const std::complex<float>* input, std::complex<float>* output, bool inverse) override
+    {
+        fft.perform (input, output, inverse);
+    }
+
+    void performRealOnlyForwardTransform (float* data) override
+    {
+        fft.performRealOnlyForwardTransform (data);
+    }
+
+    void performRealOnlyInverseTransform (float* data) override
+    {
+        fft.performRealOnlyInverseTransform (data);
+    }
+
+private:
+    StockhamFFT fft;
+};
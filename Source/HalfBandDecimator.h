@@ -0,0 +1,130 @@
+/*
+  ==============================================================================
+
+    HalfBandDecimator.h
+    Author:  Sami S
+
+    Cascade of half-band FIR stages, each one low-passing at a quarter of its
+    input rate and keeping every other sample. Half of a half-band filter's
+    taps are zero and the rest are symmetric, so each output sample costs
+    (numTaps + 1) / 4 multiplies plus the centre tap.
+
+    Used to run the pitch tracker at a fixed rate whatever the host rate is.
+
+  ==============================================================================
+*/
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+class HalfBandDecimator
+{
+public:
+    HalfBandDecimator() = default;
+    ~HalfBandDecimator() = default;
+
+    //decimate by 2^numStages
+    void prepare (int numStages)
+    {
+        stages.assign (numStages, Stage());
+        for (auto& stage : stages) {
+            stage.history.assign (2 * numTaps, 0.0f);
+            stage.position = 0;
+            stage.keepNext = false;
+        }
+
+        //windowed sinc with its cutoff at a quarter of the rate, only the odd taps are non zero
+        const double pi = 3.14159265358979323846;
+        const int halfLength = (numTaps - 1) / 2;
+        for (int tap = 0; tap < numOddTaps; ++tap) {
+            const int n = 2 * tap + 1;
+            const double x = pi * (double)n / 2.0;
+            const double window = 0.42 + 0.5 * cos (pi * (double)n / (double)(halfLength + 1))
+                                       + 0.08 * cos (2.0 * pi * (double)n / (double)(halfLength + 1));
+            coefficients[tap] = (float)(0.5 * sin (x) / x * window);
+        }
+    }
+
+    void reset()
+    {
+        for (auto& stage : stages) {
+            std::fill (stage.history.begin(), stage.history.end(), 0.0f);
+            stage.position = 0;
+            stage.keepNext = false;
+        }
+    }
+
+    int getFactor() const { return 1 << (int)stages.size(); }
+
+    //number of stages that brings sampleRate down to between trackingRate and twice that
+    static int getNumStages (double sampleRate, double trackingRate)
+    {
+        int numStages = 0;
+        while (sampleRate / (double)(2 << numStages) >= trackingRate)
+            ++numStages;
+        return numStages;
+    }
+
+    //decimates numSamples from input into output (can be the same buffer) and returns the number of output samples
+    int process (const float* input, float* output, int numSamples)
+    {
+        if (stages.empty()) {
+            if (output != input)
+                std::copy (input, input + numSamples, output);
+            return numSamples;
+        }
+
+        int numOutputs = processStage (stages[0], input, output, numSamples);
+        for (size_t stage = 1; stage < stages.size(); ++stage)
+            numOutputs = processStage (stages[stage], output, output, numOutputs);
+
+        return numOutputs;
+    }
+
+private:
+    enum {
+        numTaps = 23,
+        numOddTaps = (numTaps + 1) / 4,
+    };
+
+    struct Stage
+    {
+        //delay line written twice so the filter always reads numTaps contiguous samples
+        std::vector<float> history;
+        int position;
+        bool keepNext;
+    };
+
+    int processStage (Stage& stage, const float* input, float* output, int numSamples)
+    {
+        const int centre = (numTaps - 1) / 2;
+        int numOutputs = 0;
+
+        for (int sample = 0; sample < numSamples; ++sample) {
+            stage.history[stage.position] = input[sample];
+            stage.history[stage.position + numTaps] = input[sample];
+            if (++stage.position >= numTaps)
+                stage.position = 0;
+
+            //only every other output is needed
+            stage.keepNext = !stage.keepNext;
+            if (!stage.keepNext)
+                continue;
+
+            const float* x = stage.history.data() + stage.position;
+            float out = 0.5f * x[centre];
+            for (int tap = 0; tap < numOddTaps; ++tap) {
+                const int offset = 2 * tap + 1;
+                out += coefficients[tap] * (x[centre - offset] + x[centre + offset]);
+            }
+            output[numOutputs++] = out;
+        }
+
+        return numOutputs;
+    }
+
+    std::vector<Stage> stages;
+    float coefficients[numOddTaps] = {};
+};
@@ -0,0 +1,707 @@
+#include "HarmonizerEngine.h"
+
+#include <algorithm>
+#include <cmath>
+
+//==============================================================================
+
+HarmonizerEngine::HarmonizerEngine()
+    : createFFT ([](int order, std::shared_ptr<const StockhamFFT::Twiddles> twiddles) -> std::unique_ptr<FFTEngine> {
+          if (twiddles != nullptr && twiddles->order == order)
+              return std::make_unique<VendoredFFTEngine> (std::move (twiddles));
+          return std::make_unique<VendoredFFTEngine> (order);
+      })
+{
+}
+
+void HarmonizerEngine::setFFTFactory (FFTFactory newFactory)
+{
+    createFFT = std::move (newFactory);
+}
+
+//init the rings and every per frame buffer for the configured size. the rings hold a batch more than one frame
+void HarmonizerEngine::prepare (const Config& newConfig)
+{
+    config = newConfig;
+    const int fftSize = config.fftSize;
+    const int numChannels = config.numChannels;
+    const int numAnalysisChannels = getNumAnalysisChannels();
+    const int numPhaseChannels = config.sharedAnalysis ? 1 : numChannels;
+    const int blockSize = std::max (1, config.maxBlockSize);
+    batchLength = std::min (config.batchLength > 0 ? std::min (config.batchLength, blockSize) : blockSize, (int)maxBatchLength);
+
+    //the dry signal is read a latency back, the analysis window is inside that
+    inputBufferLength = getLatencySamples (fftSize) + batchLength;
+    inputBufferWritePosition = 0;
+    inputBuffer.assign (numAnalysisChannels * inputBufferLength, 0.0f);
+
+    //Same for output buffer and its params
+    float maxRatio = powf (2.0f, -12.0f / 12.0f);
+    outputBufferLength = (int)floorf ((float)fftSize / maxRatio) + batchLength;
+    outputBufferWritePosition = 0;
+    outputBufferReadPosition = 0;
+    outputBuffer.assign (numChannels * outputBufferLength, 0.0f);
+
+    //a batch holds a frame every hop, and the hop is at least an eighth of the window
+    maxBatchFrames = batchLength / std::max (1, fftSize / 8) + 1;
+    const int envelopeSize = std::min (fftSize, (int)maxEnvelopeSize);
+
+    workspaces.clear();
+    workspaces.resize (config.parallelChannels ? numChannels : 1);
+    for (Workspace& workspace : workspaces) {
+        workspace.fftTimeDomain.assign (fftSize, 0.0f);
+        workspace.batchFrames.assign (maxBatchFrames, BatchFrame());
+        workspace.batchSpectra.assign (maxBatchFrames * fftSize, 0.0f);
+        workspace.batchMagnitudes.assign (maxBatchFrames * fftSize, 0.0f);
+        workspace.batchPhases.assign (maxBatchFrames * fftSize, 0.0f);
+
+        //a resampled frame is at most as long as the output ring without its batch
+        workspace.resampledOutput.assign (outputBufferLength, 0.0f);
+
+        workspace.envelopeFFT = createFFT ((int)std::log2 (envelopeSize), nullptr);
+        workspace.envelopeSpectrum.assign (envelopeSize, 0.0f);
+        workspace.envelopeCepstrum.assign (envelopeSize, 0.0f);
+        workspace.formantGains.assign (fftSize, 1.0f);
+    }
+
+    synthesisWindow.assign (outputBufferLength, 0.0f);
+    synthesisWindowLength = 0;
+
+    downmixBuffer.assign (config.sharedAnalysis ? batchLength : 0, 0.0f);
+    downmixGains.assign (numChannels, 1.0f / (float)std::max (1, numChannels));
+    batchPhasors.assign (config.sharedAnalysis ? maxBatchFrames * fftSize : 0, 0.0f);
+
+    frameMagnitude.assign (fftSize, 0.0f);
+    framePhaseAdvance.assign (fftSize, 0.0f);
+
+    inputPhase.assign (numPhaseChannels * fftSize, 0.0f);
+    outputPhase.assign (numPhaseChannels * fftSize, 0.0f);
+
+    needToInitialisePhases.assign (numPhaseChannels, true);
+    inputEnergy.assign (numAnalysisChannels, 0.0);
+    gateHoldRemaining.assign (numAnalysisChannels, 0);
+
+    samplesSinceLastFFT = 0;
+    frameIndex = 0;
+    noteTracker.prepare (config.sampleRate);
+
+    updateHopSize();
+    updateTables();
+    reset();
+}
+
+void HarmonizerEngine::reset()
+{
+    std::fill (needToInitialisePhases.begin(), needToInitialisePhases.end(), true);
+    std::fill (inputEnergy.begin(), inputEnergy.end(), 0.0);
+    std::fill (gateHoldRemaining.begin(), gateHoldRemaining.end(), 0);
+
+    passThrough = false;
+    passThroughGain = 0.0f;
+    noteTracker.reset();
+}
+
+void HarmonizerEngine::setOverlap (int newOverlap)
+{
+    config.overlap = newOverlap;
+    updateHopSize();
+    updateTables();
+
+    //the phase advance of the next frame no longer spans one hop
+    std::fill (needToInitialisePhases.begin(), needToInitialisePhases.end(), true);
+}
+
+//the next frame is due one hop from the current read position, also when changing hop mid-stream
+void HarmonizerEngine::updateHopSize()
+{
+    if (config.overlap <= 0)
+        return;
+
+    hopSize = config.fftSize / config.overlap;
+    outputBufferWritePosition = (outputBufferReadPosition + hopSize) % outputBufferLength;
+    samplesSinceLastFFT = 0;
+}
+
+//fetch the shared analysis window, omega and fft twiddles for the current size, window type and overlap
+void HarmonizerEngine::updateTables()
+{
+    tables = SharedTables::get (config.fftSize, config.windowType, config.overlap);
+
+    //init fft instances, their work buffers stay per workspace
+    for (Workspace& workspace : workspaces)
+        workspace.fft = createFFT ((int)std::log2 (config.fftSize), tables->fftTwiddles);
+}
+
+//sqrt of the window for resampled frames of this length
+void HarmonizerEngine::updateSynthesisWindow (int length)
+{
+    if (length == synthesisWindowLength)
+        return;
+
+    SharedTables::fillWindow (synthesisWindow.data(), length, config.windowType);
+    for (int index = 0; index < length; ++index)
+        synthesisWindow[index] = sqrtf (synthesisWindow[index]);
+    synthesisWindowLength = length;
+}
+
+void HarmonizerEngine::setGate (float thresholdDb, float holdMs)
+{
+    gateThreshold = thresholdDb > -120.0f ? std::pow (10.0f, thresholdDb * 0.05f) : 0.0f;
+    gateHoldMs = holdMs;
+}
+
+void HarmonizerEngine::setPitchDetector (PitchDetector* newDetector)
+{
+    detector = newDetector;
+}
+
+void HarmonizerEngine::setFormantPreservation (bool shouldPreserve)
+{
+    preserveFormants = shouldPreserve;
+}
+
+void HarmonizerEngine::setNoteTracking (float minConfidence, float hysteresis, float minNoteMs)
+{
+    noteTracker.setParameters (minConfidence, hysteresis, minNoteMs);
+}
+
+void HarmonizerEngine::setPlayedNote (int midiNote)
+{
+    playedNote = midiNote;
+}
+
+void HarmonizerEngine::setAnalysisStore (AnalysisStore* newStore)
+{
+    store = newStore;
+}
+
+void HarmonizerEngine::setFrameObserver (FrameObserver* newObserver)
+{
+    observer = newObserver;
+}
+
+void HarmonizerEngine::setDownmix (const float* gains)
+{
+    std::copy (gains, gains + config.numChannels, downmixGains.begin());
+}
+
+void HarmonizerEngine::setChannelExecutor (ChannelExecutor* newExecutor)
+{
+    executor = newExecutor;
+}
+
+void HarmonizerEngine::downmix (const float* const* inputs, int startSample, int numSamples, float* destination) const
+{
+    std::fill (destination, destination + numSamples, 0.0f);
+    for (int channel = 0; channel < config.numChannels; ++channel) {
+        const float gain = downmixGains[channel];
+        if (gain == 0.0f)
+            continue;
+
+        const float* input = inputs[channel] + startSample;
+        for (int sample = 0; sample < numSamples; ++sample)
+            destination[sample] += gain * input[sample];
+    }
+}
+
+void HarmonizerEngine::process (const float* const* inputs, float* const* outputs, int numSamples)
+{
+    processBlock (inputs, outputs, numSamples, nullptr);
+}
+
+void HarmonizerEngine::process (const float* const* inputs, float* const* outputs, int numSamples, PitchEstimate estimate)
+{
+    processBlock (inputs, outputs, numSamples, &estimate);
+}
+
+//==============================================================================
+
+void HarmonizerEngine::processBlock (const float* const* inputs, float* const* outputs, int numSamples, const PitchEstimate* externalEstimate)
+{
+    const int numChannels = config.numChannels;
+    const int fftSize = config.fftSize;
+    const bool sharedAnalysis = config.sharedAnalysis;
+
+    BatchContext batch;
+    batch.engine = this;
+    batch.inputs = inputs;
+    batch.outputs = outputs;
+
+    //silence gate: windowed input energy below this (over fftSize samples) skips the frame
+    batch.gateEnergyThreshold = (double)gateThreshold * (double)gateThreshold * (double)fftSize;
+    batch.gateHoldSamples = (int)(gateHoldMs * 1e-3f * (float)config.sampleRate);
+
+    //a tracker working on analysis frames is fed by the stft below, the others take channel 0 (or the
+    //downmix) as it comes
+    batch.frameDetector = detector != nullptr && detector->usesAnalysisFrames() ? detector : nullptr;
+    const bool pushSamples = externalEstimate == nullptr && detector != nullptr;
+
+    //f_0 tracking, skipped on silent blocks where the last tracked voice is held
+    double sumOfSquares = 0.0;
+    if (sharedAnalysis) {
+        //the downmix buffer holds a batch, longer blocks are mixed down in pieces
+        for (int start = 0; start < numSamples; start += batchLength) {
+            const int length = std::min (batchLength, numSamples - start);
+            downmix (inputs, start, length, downmixBuffer.data());
+            if (pushSamples)
+                detector->pushSamples (downmixBuffer.data(), length);
+            for (int sample = 0; sample < length; ++sample)
+                sumOfSquares += (double)downmixBuffer[sample] * (double)downmixBuffer[sample];
+        }
+    }
+    else {
+        if (pushSamples)
+            detector->pushSamples (inputs[0], numSamples);
+        for (int sample = 0; sample < numSamples; ++sample)
+            sumOfSquares += (double)inputs[0][sample] * (double)inputs[0][sample];
+    }
+    const float rmsLevel = numSamples > 0 ? (float)std::sqrt (sumOfSquares / numSamples) : 0.0f;
+
+    float frequency = 0.0f;
+    int midiVoice = midiVoiceCurrent;
+    PitchEstimate estimate { 0.0f, 0.0f };
+    if (rmsLevel >= gateThreshold && (externalEstimate != nullptr || detector != nullptr)) {
+        estimate = externalEstimate != nullptr ? *externalEstimate : detector->getPitch();
+        frequency = estimate.frequency;
+        midiVoice = noteTracker.update (estimate, numSamples);
+    }
+
+    int midiPlayed = playedNote;
+
+    //calc shift using midi for a quick and dirty quantization to the 12 tone western scale
+    float delta = midiPlayed - midiVoice;
+    float shiftCurrent = pow (2.0f, (delta) / 12.0f);
+
+    //very primitive safeguard for shifting
+    if (std::abs (shiftCurrent - shift) < 12) shift = shiftCurrent;
+
+    //a new note restarts the phases from the next analysis frame. the note tracker keeps this to real
+    //transitions, and the phase buffers are overwritten by that frame rather than cleared
+    if (midiPlayedCurrent != midiPlayed || midiVoiceCurrent != midiVoice)
+    {
+        midiPlayedCurrent = midiPlayed;
+        midiVoiceCurrent = midiVoice;
+        std::fill (needToInitialisePhases.begin(), needToInitialisePhases.end(), true);
+    }
+
+    //the output ring fits frames resampled down to an octave, centred on their window. deeper shifts are held there
+    float ratio = std::max (0.5f, roundf (shift * (float)hopSize) / (float)hopSize);
+    int resampledLength = floorf ((float)fftSize / ratio);
+
+    //nothing to shift (no voice tracked, no note held or unity ratio): route the input through
+    //the input ring, which delays it by the vocoder's latency, and skip the stft
+    const bool shouldPassThrough = midiVoice < 0 || midiPlayed < 0 || ratio == 1.0f;
+    if (passThrough && !shouldPassThrough)
+        std::fill (needToInitialisePhases.begin(), needToInitialisePhases.end(), true);
+    passThrough = shouldPassThrough;
+
+    state.frequency = frequency;
+    state.confidence = estimate.confidence;
+    state.midiVoice = midiVoice;
+    state.midiPlayed = midiPlayed;
+    state.shift = shift;
+    state.ratio = ratio;
+    state.passThrough = passThrough;
+
+    if (!passThrough)
+        updateSynthesisWindow (resampledLength);
+
+    batch.estimate = estimate;
+    batch.frequency = frequency;
+    batch.ratio = ratio;
+    batch.resampledLength = resampledLength;
+
+    //offline renders can record their analysis, or replay a recorded one instead of analysing again
+    batch.recordingAnalysis = store != nullptr && store->isRecording();
+
+    //the store is written in frame order from one thread
+    const bool parallel = config.parallelChannels && executor != nullptr && store == nullptr && numChannels > 1;
+
+    //the block is processed in batches of at most batchLength samples. each batch runs in stages over
+    //all the frames due in it: input, forward ffts, bin pass, inverse ffts with overlap-add, output
+    for (int batchStart = 0; batchStart < numSamples; batchStart += batchLength) {
+        batch.start = batchStart;
+        batch.numSamples = std::min (batchLength, numSamples - batchStart);
+
+        //the downmix is analysed first, every channel takes its phases from it
+        if (sharedAnalysis) {
+            downmix (inputs, batch.start, batch.numSamples, downmixBuffer.data());
+            processChannel (numChannels, workspaces[0], batch);
+        }
+
+        if (parallel) {
+            executor->run (numChannels, processChannelTask, &batch);
+        }
+        else {
+            for (int channel = 0; channel < numChannels; ++channel)
+                processChannel (channel, workspaces[0], batch);
+        }
+
+        //set buffer position values, every channel moved through the rings and the hop alike
+        const Workspace& last = workspaces[parallel ? numChannels - 1 : 0];
+        inputBufferWritePosition = last.inputBufferWritePosition;
+        outputBufferWritePosition = last.outputBufferWritePosition;
+        outputBufferReadPosition = last.outputBufferReadPosition;
+        samplesSinceLastFFT = last.samplesSinceLastFFT;
+        passThroughGain = last.passThroughGain;
+        frameIndex += last.numFrames;
+    }
+}
+
+void HarmonizerEngine::processChannelTask (void* context, int channel)
+{
+    const BatchContext& batch = *static_cast<const BatchContext*> (context);
+    batch.engine->processChannel (channel, batch.engine->workspaces[channel], batch);
+}
+
+//one batch of one channel, or of the downmix at index numChannels. the downmix is only analysed: it is
+//never gated, feeds the tracker and the observer and leaves the phasors the channels are synthesised with
+void HarmonizerEngine::processChannel (int channel, Workspace& workspace, const BatchContext& batch)
+{
+    const int fftSize = config.fftSize;
+    const int batchSamples = batch.numSamples;
+    const float ratio = batch.ratio;
+    const int resampledLength = batch.resampledLength;
+    const bool isDownmix = channel == config.numChannels;
+    const bool isTracked = config.sharedAnalysis ? isDownmix : channel == 0;
+    //with a shared analysis only the downmix has phases of its own
+    const bool tracksPhases = !config.sharedAnalysis || isDownmix;
+    const int phaseChannel = config.sharedAnalysis ? 0 : channel;
+    PitchDetector* frameDetector = batch.frameDetector;
+
+    const float* channelInput = isDownmix ? downmixBuffer.data() : batch.inputs[channel] + batch.start;
+    float* channelOutput = isDownmix ? nullptr : batch.outputs[channel] + batch.start;
+    float* channelInputBuffer = inputBuffer.data() + channel * inputBufferLength;
+    float* channelOutputBuffer = isDownmix ? nullptr : outputBuffer.data() + channel * outputBufferLength;
+
+    //init current buffer positions
+    int currentInputBufferWritePosition = inputBufferWritePosition;
+    int currentOutputBufferWritePosition = outputBufferWritePosition;
+    int currentOutputBufferReadPosition = outputBufferReadPosition;
+    int currentSamplesSinceLastFFT = samplesSinceLastFFT;
+    float currentPassThroughGain = passThroughGain;
+    double currentInputEnergy = inputEnergy[channel];
+    int currentGateHoldRemaining = gateHoldRemaining[channel];
+
+    //a tracker on analysis frames still needs its channel analysed while passing through
+    const bool analysisOnly = passThrough && frameDetector != nullptr && isTracked;
+    const bool shapeFormants = preserveFormants && !passThrough && !isDownmix;
+
+    //input stage
+    //
+    //store the input in the ring and note where each frame due in the batch starts
+    int numFrames = 0;
+    for (int sample = 0; sample < batchSamples; ++sample) {
+        const float in = channelInput[sample];
+        //the ring holds fftSize samples more than a batch, so the window of every frame is still intact
+        int leavingPosition = currentInputBufferWritePosition - fftSize;
+        if (leavingPosition < 0)
+            leavingPosition += inputBufferLength;
+        const float leaving = channelInputBuffer[leavingPosition];
+
+        channelInputBuffer[currentInputBufferWritePosition] = in;
+        if (++currentInputBufferWritePosition >= inputBufferLength)
+            currentInputBufferWritePosition = 0;
+
+        //running energy of the last fftSize input samples
+        currentInputEnergy += (double)in * (double)in - (double)leaving * (double)leaving;
+
+        //check if enough samples have come in according to hopsize
+        if (++currentSamplesSinceLastFFT >= hopSize) {
+            currentSamplesSinceLastFFT = 0;
+
+            //the gate stays open for the hold time after the last frame above the threshold
+            currentInputEnergy = std::max (0.0, currentInputEnergy);
+            if (currentInputEnergy >= batch.gateEnergyThreshold || isDownmix)
+                currentGateHoldRemaining = batch.gateHoldSamples;
+            else
+                currentGateHoldRemaining = std::max (-1, currentGateHoldRemaining - hopSize);
+
+            //the resampled frame is centred a window after the hop, so the centre of the analysis window comes
+            //out a latency later whatever the ratio. down an octave the frame starts right on the hop
+            BatchFrame& frame = workspace.batchFrames[numFrames++];
+            frame.inputStart = leavingPosition + 1 < inputBufferLength ? leavingPosition + 1 : 0;
+            frame.outputStart = currentOutputBufferWritePosition + fftSize - resampledLength / 2;
+            if (frame.outputStart >= outputBufferLength)
+                frame.outputStart -= outputBufferLength;
+            //pass-through and gated frames keep the hop grid moving but skip the fft, bin loop,
+            //ifft and resample. gated frames let the overlap-add tail decay into silence
+            frame.analyse = currentGateHoldRemaining >= 0 && (!passThrough || analysisOnly);
+            frame.gated = currentGateHoldRemaining < 0;
+
+            //move write buffer by hop increments
+            currentOutputBufferWritePosition += hopSize;
+            if (currentOutputBufferWritePosition >= outputBufferLength)
+                currentOutputBufferWritePosition -= outputBufferLength;
+        }
+    }
+
+    //analysis stage
+    //
+    //apply window on input and transform every analysed frame (imag is 0.0 since real signal), then
+    //split it into magnitude and phase. a recording analyses every frame, a replay reads them back
+    for (int frameIndexInBatch = 0; frameIndexInBatch < numFrames; ++frameIndexInBatch) {
+        const BatchFrame& frame = workspace.batchFrames[frameIndexInBatch];
+        if (!frame.analyse && !batch.recordingAnalysis)
+            continue;
+
+        float* magnitudes = workspace.batchMagnitudes.data() + frameIndexInBatch * fftSize;
+        float* phases = workspace.batchPhases.data() + frameIndexInBatch * fftSize;
+        const bool replayed = store != nullptr
+                           && store->readFrame (frameIndex + frameIndexInBatch, channel, magnitudes, phases, nullptr);
+
+        if (!replayed) {
+            int inputBufferIndex = frame.inputStart;
+            for (int index = 0; index < fftSize; ++index) {
+                workspace.fftTimeDomain[index].real (tables->sqrtWindow[index] * channelInputBuffer[inputBufferIndex]);
+                workspace.fftTimeDomain[index].imag (0.0f);
+
+                if (++inputBufferIndex >= inputBufferLength)
+                    inputBufferIndex = 0;
+            }
+
+            std::complex<float>* spectrum = workspace.batchSpectra.data() + frameIndexInBatch * fftSize;
+            workspace.fft->perform (workspace.fftTimeDomain.data(), spectrum, false);
+
+            if (tracksPhases || batch.recordingAnalysis) {
+                for (int index = 0; index < fftSize; ++index) {
+                    magnitudes[index] = std::abs (spectrum[index]);
+                    phases[index] = std::arg (spectrum[index]);
+                }
+            }
+            else {
+                //the phases come from the downmix, the magnitude needs no atan2 and no overflow safe hypot
+                for (int index = 0; index < fftSize; ++index)
+                    magnitudes[index] = std::sqrt (std::norm (spectrum[index]));
+            }
+
+            if (batch.recordingAnalysis)
+                store->writeFrame (frameIndex + frameIndexInBatch, channel, magnitudes, phases, batch.estimate);
+        }
+
+        if (observer != nullptr && isTracked && frame.analyse)
+            observer->frameAnalysed (magnitudes, fftSize, hopSize);
+    }
+
+    //modification stage
+    //
+    //phases carry over from frame to frame, so the frames go through the bin loop in order
+    for (int frameIndexInBatch = 0; frameIndexInBatch < numFrames; ++frameIndexInBatch) {
+        const BatchFrame& frame = workspace.batchFrames[frameIndexInBatch];
+        if (!frame.analyse) {
+            if (frame.gated && tracksPhases && (!passThrough || analysisOnly))
+                needToInitialisePhases[phaseChannel] = true;
+            continue;
+        }
+
+        std::complex<float>* spectrum = workspace.batchSpectra.data() + frameIndexInBatch * fftSize;
+        std::complex<float>* phasors = batchPhasors.data() + frameIndexInBatch * fftSize;
+        const float* magnitudes = workspace.batchMagnitudes.data() + frameIndexInBatch * fftSize;
+        const float* phases = workspace.batchPhases.data() + frameIndexInBatch * fftSize;
+
+        //the envelope of this frame, from the magnitudes the shift uses anyway
+        if (shapeFormants)
+            updateFormantGains (workspace, magnitudes, ratio, batch.frequency);
+        const float* formantGains = workspace.formantGains.data();
+
+        //a shared analysis leaves this channel only its magnitudes to scale the downmix phasors with
+        if (!tracksPhases) {
+            for (int index = 0; index < fftSize; ++index)
+                spectrum[index] = phasors[index] * (shapeFormants ? magnitudes[index] * formantGains[index] : magnitudes[index]);
+            continue;
+        }
+
+        //the first frame after a phase initialisation has no phase advance to track pitch from
+        const bool collectSpectrum = frameDetector != nullptr && isTracked && !needToInitialisePhases[phaseChannel];
+        const bool initialisePhases = needToInitialisePhases[phaseChannel];
+        float* channelInputPhase = inputPhase.data() + phaseChannel * fftSize;
+        float* channelOutputPhase = outputPhase.data() + phaseChannel * fftSize;
+
+        for (int index = 0; index < fftSize; ++index) {
+
+            //initialize magnitude and phase
+            float magnitude = magnitudes[index];
+            float phase = phases[index];
+
+            //calculate needed phase shift according to deltaPhi and ratio
+            float newPhase = phase;
+            if (!initialisePhases) {
+                float phaseDeviation = phase - channelInputPhase[index] - tables->omega[index] * (float)hopSize;
+                float deltaPhi = tables->omega[index] * hopSize + princArg (phaseDeviation);
+                newPhase = princArg (channelOutputPhase[index] + deltaPhi * ratio);
+
+                //deltaPhi is the bin's instantaneous frequency in radians per hop
+                if (collectSpectrum) {
+                    frameMagnitude[index] = magnitude;
+                    framePhaseAdvance[index] = deltaPhi;
+                }
+            }
+
+            //store phases in buffers to keep track of phase
+            channelInputPhase[index] = phase;
+            channelOutputPhase[index] = newPhase;
+
+            //store
+            if (isDownmix)
+                phasors[index] = std::polar (1.0f, newPhase);
+            else if (!analysisOnly)
+                spectrum[index] = std::polar (shapeFormants ? magnitude * formantGains[index] : magnitude, newPhase);
+        }
+
+        //the first frame after pass-through or the gate starts from the analysis phases
+        needToInitialisePhases[phaseChannel] = false;
+
+        //the estimate is read back by the next block
+        if (collectSpectrum)
+            frameDetector->analyseFrame (frameMagnitude.data(), framePhaseAdvance.data(), fftSize, hopSize);
+    }
+
+    //synthesis stage
+    //
+    //inverse fft every frame, resample it and overlap-add it where its hop starts in the output ring
+    if (!passThrough && !isDownmix) {
+        const float windowScaleFactor = tables->windowScaleFactor;
+
+        for (int frameIndexInBatch = 0; frameIndexInBatch < numFrames; ++frameIndexInBatch) {
+            const BatchFrame& frame = workspace.batchFrames[frameIndexInBatch];
+            if (!frame.analyse)
+                continue;
+
+            const std::complex<float>* fftTimeDomain = workspace.fftTimeDomain.data();
+            float* resampledOutput = workspace.resampledOutput.data();
+            workspace.fft->perform (workspace.batchSpectra.data() + frameIndexInBatch * fftSize, workspace.fftTimeDomain.data(), true);
+
+            for (int index = 0; index < resampledLength; ++index) {
+                //reconstruct signal
+                float x = (float)index * (float)fftSize / (float)resampledLength;
+                int ix = (int)floorf (x);
+                float dx = x - (float)ix;
+
+                float sample1 = fftTimeDomain[ix].real();
+                float sample2 = fftTimeDomain[(ix + 1) % fftSize].real();
+                resampledOutput[index] = sample1 + dx * (sample2 - sample1);
+                resampledOutput[index] *= synthesisWindow[index];
+            }
+
+            //store resampled ouput signal in system output buffer and scale according to ratio
+            int outputBufferIndex = frame.outputStart;
+            for (int index = 0; index < resampledLength; ++index) {
+                channelOutputBuffer[outputBufferIndex] += resampledOutput[index] * windowScaleFactor;
+
+                if (++outputBufferIndex >= outputBufferLength)
+                    outputBufferIndex = 0;
+            }
+        }
+    }
+
+    //output stage
+    //
+    //the output ring holds a batch more than the longest resampled frame, so every frame of the batch
+    //was added before its first sample is read. the input a latency back is the dry signal
+    if (!isDownmix) {
+        //crossfade between the vocoder and the delayed input over one window length
+        const float passThroughStep = 1.0f / (float)fftSize;
+
+        int dryPosition = currentInputBufferWritePosition - batchSamples - getLatencySamples (fftSize);
+        while (dryPosition < 0)
+            dryPosition += inputBufferLength;
+
+        for (int sample = 0; sample < batchSamples; ++sample) {
+            const float dry = channelInputBuffer[dryPosition];
+            const float wet = channelOutputBuffer[currentOutputBufferReadPosition];
+
+            if (passThrough)
+                currentPassThroughGain = std::min (1.0f, currentPassThroughGain + passThroughStep);
+            else
+                currentPassThroughGain = std::max (0.0f, currentPassThroughGain - passThroughStep);
+
+            //store output
+            channelOutput[sample] = wet + currentPassThroughGain * (dry - wet);
+
+            //zero the output once read. reset read positions if needed
+            channelOutputBuffer[currentOutputBufferReadPosition] = 0.0f;
+            if (++currentOutputBufferReadPosition >= outputBufferLength)
+                currentOutputBufferReadPosition = 0;
+
+            if (++dryPosition >= inputBufferLength)
+                dryPosition = 0;
+        }
+    }
+
+    inputEnergy[channel] = currentInputEnergy;
+    gateHoldRemaining[channel] = currentGateHoldRemaining;
+
+    workspace.inputBufferWritePosition = currentInputBufferWritePosition;
+    workspace.outputBufferWritePosition = currentOutputBufferWritePosition;
+    workspace.outputBufferReadPosition = currentOutputBufferReadPosition;
+    workspace.samplesSinceLastFFT = currentSamplesSinceLastFFT;
+    workspace.passThroughGain = currentPassThroughGain;
+    workspace.numFrames = numFrames;
+}
+
+//resampling moves bin k to k * ratio, envelope and all. this finds the log envelope of the frame by
+//cepstral liftering at no more than maxEnvelopeSize points and sets the gain that gives every bin the
+//envelope found where it is moved to, so the formants stay where they were
+void HarmonizerEngine::updateFormantGains (Workspace& workspace, const float* magnitudes, float ratio, float fundamental)
+{
+    const int fftSize = config.fftSize;
+    std::vector<std::complex<float>>& envelopeSpectrum = workspace.envelopeSpectrum;
+    std::vector<std::complex<float>>& envelopeCepstrum = workspace.envelopeCepstrum;
+    std::vector<float>& formantGains = workspace.formantGains;
+    const int envelopeSize = (int)envelopeSpectrum.size();
+    const int decimation = fftSize / envelopeSize;
+
+    //mean log magnitude around every decimated bin, which also keeps the harmonics of a large fft from
+    //folding into the low quefrencies. the spectrum of a real frame is symmetric, so the edges wrap around
+    for (int point = 0; point <= envelopeSize / 2; ++point) {
+        float sum = 0.0f;
+        for (int offset = 0; offset < decimation; ++offset) {
+            const int bin = (point * decimation + offset - decimation / 2 + fftSize) % fftSize;
+            sum += std::log (magnitudes[bin] + 1.0e-9f);
+        }
+
+        envelopeSpectrum[point] = sum / (float)decimation;
+        if (point > 0 && point < envelopeSize / 2)
+            envelopeSpectrum[envelopeSize - point] = envelopeSpectrum[point];
+    }
+
+    workspace.envelopeFFT->perform (envelopeSpectrum.data(), envelopeCepstrum.data(), true);
+
+    //keep the quefrencies below half the pitch period, the ripple of the harmonics is above
+    const float period = (float)config.sampleRate / (fundamental > 0.0f ? std::max (fundamental, 60.0f) : 200.0f);
+    const int cutoff = std::min (std::max ((int)(0.5f * period), 2), envelopeSize / 2 - 1);
+    for (int index = cutoff + 1; index < envelopeSize - cutoff; ++index)
+        envelopeCepstrum[index] = 0.0f;
+
+    workspace.envelopeFFT->perform (envelopeCepstrum.data(), envelopeSpectrum.data(), false);
+
+    //no more than 24 dB of boost, so noise between the formants is not pulled up to them
+    const float maxLogGain = 2.76f;
+    const float lastPoint = (float)(envelopeSize / 2);
+    for (int bin = 0; bin <= fftSize / 2; ++bin) {
+        const float source = (float)bin / (float)decimation;
+        const float target = std::min (source * ratio, lastPoint);
+        formantGains[bin] = std::exp (std::min (getLogEnvelope (workspace, target) - getLogEnvelope (workspace, source), maxLogGain));
+    }
+    for (int bin = fftSize / 2 + 1; bin < fftSize; ++bin)
+        formantGains[bin] = formantGains[fftSize - bin];
+}
+
+//linear interpolation of the smoothed log envelope between decimated bins
+float HarmonizerEngine::getLogEnvelope (const Workspace& workspace, float point)
+{
+    const std::vector<std::complex<float>>& envelopeSpectrum = workspace.envelopeSpectrum;
+    const int lastPoint = (int)envelopeSpectrum.size() / 2;
+    const int index = std::min ((int)point, lastPoint);
+    const int next = std::min (index + 1, lastPoint);
+    const float fraction = point - (float)index;
+    return envelopeSpectrum[index].real() + fraction * (envelopeSpectrum[next].real() - envelopeSpectrum[index].real());
+}
+
+//phase wrapping
+float HarmonizerEngine::princArg (const float phase)
+{
+    const double pi = 3.14159265358979323846;
+    if (phase >= 0.0f) return fmod (phase + pi,  2.0f * pi) - pi;
+    else return fmod (phase + pi, -2.0f * pi) + pi;
+}
@@ -0,0 +1,315 @@
+/*
+  ==============================================================================
+
+    HarmonizerEngine.h
+    Author:  Sami S
+
+    The harmonizer's DSP without the plugin around it: pitch tracking of
+    channel 0, the MIDI voice logic that turns the tracked and the played
+    note into a shift ratio, and the STFT phase vocoder with its silence
+    gate and pass-through. Plain C++ with no JUCE, so it can be linked into
+    render services and tests.
+
+    Surround layouts can share one analysis: the pitch and the phase
+    advance then come from a downmix of the channels, and every channel
+    only contributes its own magnitudes, so each extra channel costs an fft
+    pair and the resampling but no phase tracking. The channels of a block
+    can also be run side by side on a ChannelExecutor. HarmonizerAudioProcessor is an adapter that
+    maps its parameters onto a Config and its MIDI onto setPlayedNote.
+
+    prepare and setOverlap allocate, process never allocates or locks. The
+    caller keeps them off each other, the processor does it with its lock.
+
+  ==============================================================================
+*/
+#pragma once
+
+#include <complex>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+#include "FFTEngine.h"
+#include "NoteTracker.h"
+#include "PitchDetector.h"
+#include "SharedTables.h"
+
+class HarmonizerEngine
+{
+public:
+    struct Config
+    {
+        double sampleRate = 44100.0;
+        int numChannels = 2;
+        //longest block process is called with, longer ones are split
+        int maxBlockSize = 512;
+        //samples the stages run over at a time, 0 for maxBlockSize. only the speed depends on it, see KernelWisdom
+        int batchLength = 0;
+        //power of two, 32 to 8192
+        int fftSize = 512;
+        //frames per window
+        int overlap = 8;
+        int windowType = SharedTables::windowHann;
+        //pitch and phases from the downmix (see setDownmix) instead of channel 0 and every channel's own
+        bool sharedAnalysis = false;
+        //a workspace per channel, so the channels can run on the ChannelExecutor
+        bool parallelChannels = false;
+
+        bool operator== (const Config& other) const
+        {
+            return sampleRate == other.sampleRate && numChannels == other.numChannels && maxBlockSize == other.maxBlockSize
+                && batchLength == other.batchLength && fftSize == other.fftSize && overlap == other.overlap && windowType == other.windowType
+                && sharedAnalysis == other.sharedAnalysis && parallelChannels == other.parallelChannels;
+        }
+
+        bool operator!= (const Config& other) const
+        {
+            return !(*this == other);
+        }
+    };
+
+    //what the voice logic made of the latest block
+    struct TrackingState
+    {
+        //tracked on channel 0 or the downmix, 0 on silent blocks
+        float frequency = 0.0f;
+        float confidence = 0.0f;
+        int midiVoice = 69;
+        //-1 while no note is held
+        int midiPlayed = 69;
+        float shift = 0.0f;
+        float ratio = 1.0f;
+        bool passThrough = false;
+    };
+
+    //where analysed frames can come from or go to, such as the offline analysis cache
+    class AnalysisStore
+    {
+    public:
+        virtual ~AnalysisStore() = default;
+
+        //channels go up to getNumAnalysisChannels(). fills the fftSize bins of a stored frame. magnitudes and phases can be null for the estimate only
+        virtual bool readFrame (int64_t frame, int channel, float* magnitudes, float* phases, PitchEstimate* estimate) const = 0;
+        //while recording every frame is analysed and written, gated and pass-through ones too
+        virtual bool isRecording() const = 0;
+        virtual void writeFrame (int64_t frame, int channel, const float* magnitudes, const float* phases, PitchEstimate estimate) = 0;
+    };
+
+    //sees the channel 0 (or downmix) spectrum of every analysed frame, on the audio thread. must not block or allocate
+    class FrameObserver
+    {
+    public:
+        virtual ~FrameObserver() = default;
+
+        //fftSize magnitudes of the full spectrum, hopSize samples after the previous frame
+        virtual void frameAnalysed (const float* magnitudes, int fftSize, int hopSize) = 0;
+    };
+
+    //runs the channels of a block side by side when Config::parallelChannels is set
+    class ChannelExecutor
+    {
+    public:
+        virtual ~ChannelExecutor() = default;
+
+        using Task = void (*) (void* context, int index);
+        //calls task once for every index below numTasks, on any threads, and returns when all are done
+        virtual void run (int numTasks, Task task, void* context) = 0;
+    };
+
+    using FFTFactory = std::function<std::unique_ptr<FFTEngine> (int order, std::shared_ptr<const StockhamFFT::Twiddles> twiddles)>;
+
+    HarmonizerEngine();
+
+    //not realtime safe: reallocates every buffer and starts from silence
+    void prepare (const Config& newConfig);
+    //starts over from the current buffers, like after a transport stop
+    void reset();
+    //not realtime safe: new hop without reallocating, the phases start over
+    void setOverlap (int newOverlap);
+    //takes effect on the next prepare, the default is the vendored fft
+    void setFFTFactory (FFTFactory newFactory);
+
+    //realtime safe, silence below the threshold skips the vocoder after the hold time
+    void setGate (float thresholdDb, float holdMs);
+    //linear rms, 0 when the gate is off
+    float getGateThreshold() const { return gateThreshold; }
+    float getGateHoldMs() const { return gateHoldMs; }
+    //the tracker channel 0 is pushed to, owned by the caller. null when estimates are passed to process
+    void setPitchDetector (PitchDetector* newDetector);
+    //realtime safe, moves the spectral envelope back to where it was before the shift
+    void setFormantPreservation (bool shouldPreserve);
+    //realtime safe, see NoteTracker
+    void setNoteTracking (float minConfidence, float hysteresis, float minNoteMs);
+    //-1 releases the note, nothing is shifted while no note is held
+    void setPlayedNote (int midiNote);
+    void setAnalysisStore (AnalysisStore* newStore);
+    //null when nobody is looking, which costs nothing
+    void setFrameObserver (FrameObserver* newObserver);
+    //realtime safe, numChannels gains of the shared analysis downmix. prepare sets them all to 1 / numChannels
+    void setDownmix (const float* gains);
+    //realtime safe, owned by the caller. only used with Config::parallelChannels and no analysis store
+    void setChannelExecutor (ChannelExecutor* newExecutor);
+    //numSamples of the shared analysis downmix of inputs from startSample on
+    void downmix (const float* const* inputs, int startSample, int numSamples, float* destination) const;
+
+    //inputs and outputs have getConfig().numChannels channels and can be the same buffers
+    void process (const float* const* inputs, float* const* outputs, int numSamples);
+    //same, with the pitch of the block from elsewhere (a worker thread, a replay). the detector is not fed
+    void process (const float* const* inputs, float* const* outputs, int numSamples, PitchEstimate estimate);
+
+    const Config& getConfig() const { return config; }
+    int getHopSize() const { return hopSize; }
+    //an analysis window's centre comes out a window after its frame, so half a window more than the window
+    //itself, at every ratio. the dry signal is delayed as much. see processChannel
+    int getLatencySamples() const { return getLatencySamples (config.fftSize); }
+    static int getLatencySamples (int fftSize) { return fftSize + fftSize / 2; }
+    const TrackingState& getTrackingState() const { return state; }
+    //the input channels, then the downmix with a shared analysis
+    int getNumAnalysisChannels() const { return config.numChannels + (config.sharedAnalysis ? 1 : 0); }
+
+    //frames since prepare or resetFrameIndex, the analysis store is addressed with it
+    int64_t getFrameIndex() const { return frameIndex; }
+    void resetFrameIndex() { frameIndex = 0; }
+    //samples into the current hop
+    int getHopPhase() const { return samplesSinceLastFFT; }
+    //frames a process call of numSamples runs next, from getFrameIndex() on
+    int getNumFramesDue (int numSamples) const { return (samplesSinceLastFFT + numSamples) / hopSize; }
+
+    enum {
+        maxBatchLength = 4096,
+        //the envelope is estimated at no more points than this, whatever the fft size
+        maxEnvelopeSize = 1024,
+    };
+
+private:
+    //frames due in one batch of at most batchLength samples, see processBlock
+    struct BatchFrame
+    {
+        int inputStart;
+        int outputStart;
+        bool analyse;
+        bool gated;
+    };
+
+    //buffers a channel is processed in. the channels run in turn share one, parallel channels have one each
+    struct Workspace
+    {
+        std::unique_ptr<FFTEngine> fft;
+        std::vector<std::complex<float>> fftTimeDomain;
+
+        std::vector<BatchFrame> batchFrames;
+        std::vector<std::complex<float>> batchSpectra;
+        std::vector<float> batchMagnitudes;
+        std::vector<float> batchPhases;
+        std::vector<float> resampledOutput;
+
+        //formant preservation: cepstrum of the decimated log spectrum, the smoothed envelope and a gain per bin
+        std::unique_ptr<FFTEngine> envelopeFFT;
+        std::vector<std::complex<float>> envelopeSpectrum;
+        std::vector<std::complex<float>> envelopeCepstrum;
+        std::vector<float> formantGains;
+
+        //where the channel left the rings and the hop, every channel ends in the same place
+        int inputBufferWritePosition = 0;
+        int outputBufferWritePosition = 0;
+        int outputBufferReadPosition = 0;
+        int samplesSinceLastFFT = 0;
+        float passThroughGain = 0.0f;
+        int numFrames = 0;
+    };
+
+    //what every channel of a batch is processed with
+    struct BatchContext
+    {
+        HarmonizerEngine* engine;
+        const float* const* inputs;
+        float* const* outputs;
+        int start;
+        int numSamples;
+        PitchEstimate estimate;
+        float frequency;
+        float ratio;
+        int resampledLength;
+        double gateEnergyThreshold;
+        int gateHoldSamples;
+        PitchDetector* frameDetector;
+        bool recordingAnalysis;
+    };
+
+    void processBlock (const float* const* inputs, float* const* outputs, int numSamples, const PitchEstimate* estimate);
+    void processChannel (int channel, Workspace& workspace, const BatchContext& batch);
+    static void processChannelTask (void* context, int channel);
+    void updateHopSize();
+    void updateTables();
+    void updateSynthesisWindow (int length);
+    void updateFormantGains (Workspace& workspace, const float* magnitudes, float ratio, float fundamental);
+    static float getLogEnvelope (const Workspace& workspace, float point);
+
+    static float princArg (const float phase);
+
+    Config config;
+    FFTFactory createFFT;
+
+    //window, omega, scale factor and fft twiddles shared with other instances
+    SharedTables::Ptr tables;
+    std::vector<Workspace> workspaces;
+
+    //input rings of getNumAnalysisChannels() x length, the downmix last. output rings of numChannels x length
+    int inputBufferLength = 0;
+    int inputBufferWritePosition = 0;
+    std::vector<float> inputBuffer;
+
+    int outputBufferLength = 0;
+    int outputBufferWritePosition = 0;
+    int outputBufferReadPosition = 0;
+    std::vector<float> outputBuffer;
+
+    int samplesSinceLastFFT = 0;
+    int hopSize = 64;
+
+    int batchLength = 512;
+    int maxBatchFrames = 0;
+
+    //window of the resampled frames, it only changes with the ratio
+    std::vector<float> synthesisWindow;
+    int synthesisWindowLength = 0;
+
+    //shared analysis: the downmix of a batch, its gains, and the unit phasor of every bin of its frames
+    std::vector<float> downmixBuffer;
+    std::vector<float> downmixGains;
+    std::vector<std::complex<float>> batchPhasors;
+
+    //phases of the previous frame, numChannels x fftSize or only the downmix's with a shared analysis
+    std::vector<float> inputPhase;
+    std::vector<float> outputPhase;
+    std::vector<char> needToInitialisePhases;
+
+    //channel 0 (or downmix) analysis frame handed to trackers that use analysis frames
+    std::vector<float> frameMagnitude;
+    std::vector<float> framePhaseAdvance;
+
+    bool preserveFormants = false;
+
+    //silence gate, per channel. the downmix is never gated
+    float gateThreshold = 0.0f;
+    float gateHoldMs = 100.0f;
+    std::vector<double> inputEnergy;
+    std::vector<int> gateHoldRemaining;
+
+    //pass-through (nothing to shift) state
+    bool passThrough = false;
+    float passThroughGain = 0.0f;
+
+    PitchDetector* detector = nullptr;
+    AnalysisStore* store = nullptr;
+    FrameObserver* observer = nullptr;
+    ChannelExecutor* executor = nullptr;
+    int64_t frameIndex = 0;
+
+    NoteTracker noteTracker;
+    int playedNote = -1;
+    int midiVoiceCurrent = 69;
+    int midiPlayedCurrent = 69;
+    float shift = 0.0f;
+    TrackingState state;
+};
@@ -0,0 +1,67 @@
+/*
+  ==============================================================================
+
+    JuceFFTEngine.h
+    Author:  Sami S
+
+    The juce::dsp::FFT backend of FFTEngine, and the choice between it and
+    the vendored one. HARMONIZER_VENDORED_FFT picks the default backend at
+    build time (add it to the exporter's preprocessor definitions to
+    override).
+
+  ==============================================================================
+*/
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "FFTEngine.h"
+
+#ifndef HARMONIZER_VENDORED_FFT
+ #if JUCE_IPP_AVAILABLE || JUCE_MAC || JUCE_IOS
+  #define HARMONIZER_VENDORED_FFT 0
+ #else
+  #define HARMONIZER_VENDORED_FFT 1
+ #endif
+#endif
+
+class JuceFFTEngine : public FFTEngine
+{
+public:
+    explicit JuceFFTEngine (int order) : FFTEngine (order), fft (order)
+    {
+    }
+
+    void perform (const dsp::Complex<float>* input, dsp::Complex<float>* output, bool inverse) override
+    {
+        fft.perform (input, output, inverse);
+    }
+
+    void performRealOnlyForwardTransform (float* data) override
+    {
+        fft.performRealOnlyForwardTransform (data);
+    }
+
+    void performRealOnlyInverseTransform (float* data) override
+    {
+        fft.performRealOnlyInverseTransform (data);
+    }
+
+private:
+    dsp::FFT fft;
+};
+
+inline FFTEngine::Backend FFTEngine::getDefaultBackend()
+{
+    return HARMONIZER_VENDORED_FFT ? backendVendored : backendJuce;
+}
+
+inline std::unique_ptr<FFTEngine> FFTEngine::create (int order, Backend backend,
+                                                    std::shared_ptr<const StockhamFFT::Twiddles> twiddles)
+{
+    if (backend == backendVendored) {
+        if (twiddles != nullptr && twiddles->order == order)
+            return std::make_unique<VendoredFFTEngine> (std::move (twiddles));
+        return std::make_unique<VendoredFFTEngine> (order);
+    }
+    return std::make_unique<JuceFFTEngine> (order);
+}
@@ -0,0 +1,345 @@
+/*
+  ==============================================================================
+
+    KernelWisdom.h
+    Author:  Sami S
+
+    Which kernels are fastest on this machine, in the spirit of FFTW's
+    wisdom. Tuning times both fft backends at every fft size, and the
+    engine with its stages run over one frame, 256 samples or the whole
+    block at a time for every fft size and hop. The winners go to a small
+    xml file in the user's application data, under a signature of the cpu
+    and the build, so machines sharing a home folder each keep their own.
+    The file is read once per process and instances only look their
+    choices up. The batch length never changes the output, the backend
+    only within what the regression harness allows.
+
+    Tuning is run from the console target, see CommandLineMain.cpp:
+    harmonizer --tune-kernels [--seconds 0.05]. Plugin builds use the
+    defaults until a machine is tuned and pick the winners up the next
+    time they are prepared. Timing inside a host competes with its audio
+    and other tracks, so the in-plugin tuning that HARMONIZER_AUTOTUNE=1
+    turns on is only meant for builds that are run alone.
+
+  ==============================================================================
+*/
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "JuceFFTEngine.h"
+#include "HarmonizerEngine.h"
+#include "FFTBenchmark.h"
+#include "BenchmarkHelpers.h"
+
+#ifndef HARMONIZER_AUTOTUNE
+ #define HARMONIZER_AUTOTUNE 0
+#endif
+
+class KernelWisdom
+{
+public:
+    enum {
+        minOrder = 5,
+        maxOrder = 13,
+        numOrders = maxOrder - minOrder + 1,
+        //overlaps 2, 4 and 8
+        numOverlaps = 3,
+        //block the engine is timed with, the batch lengths tried are a frame, this and the whole block
+        tuningBlockSize = 1024,
+        fixedBatchLength = 256,
+    };
+
+    //process wide, read from disk on first use
+    static KernelWisdom& getInstance()
+    {
+        static KernelWisdom wisdom;
+        return wisdom;
+    }
+
+    ~KernelWisdom()
+    {
+        if (tuner != nullptr)
+            tuner->stopThread (10000);
+    }
+
+    bool isTuned() const
+    {
+        const ScopedLock sl (lock);
+        return tuned;
+    }
+
+    //the default backend until tuned
+    FFTEngine::Backend getBackend (int fftSize) const
+    {
+        const ScopedLock sl (lock);
+        const int order = getOrderIndex (fftSize);
+        return tuned && order >= 0 ? backends[order] : FFTEngine::getDefaultBackend();
+    }
+
+    //a HarmonizerEngine::Config::batchLength, 0 (the whole block) until tuned
+    int getBatchLength (int fftSize, int overlap) const
+    {
+        const ScopedLock sl (lock);
+        const int order = getOrderIndex (fftSize);
+        const int overlapIndex = getOverlapIndex (overlap);
+        return tuned && order >= 0 && overlapIndex >= 0 ? batchLengths[order][overlapIndex] : 0;
+    }
+
+    //not realtime safe: times every candidate for secondsPerCase, then keeps and saves the winners.
+    //returns the report, or an empty string if thread was asked to exit first
+    String tune (double secondsPerCase = 0.05, Thread* thread = nullptr)
+    {
+        FFTEngine::Backend newBackends[numOrders];
+        int newBatchLengths[numOrders][numOverlaps];
+        const AudioBuffer<float> signal = BenchmarkHelpers::createSungVowel (2, 48000.0);
+
+        String report = "Kernel wisdom for " + getCpuSignature() + "\n";
+        report << String ("size").paddedRight (' ', 8) << String ("fft").paddedRight (' ', 24)
+               << "batch at overlap 2 / 4 / 8 (0 is the whole block)\n";
+
+        for (int order = minOrder; order <= maxOrder; ++order) {
+            const int orderIndex = order - minOrder;
+
+            double fastest = 0.0;
+            for (int backend = 0; backend < FFTEngine::numBackends; ++backend) {
+                if (thread != nullptr && thread->threadShouldExit())
+                    return {};
+
+                auto fft = FFTEngine::create (order, (FFTEngine::Backend)backend);
+                const double time = FFTBenchmark::timeComplex (*fft, secondsPerCase);
+                if (backend == 0 || time < fastest) {
+                    fastest = time;
+                    newBackends[orderIndex] = (FFTEngine::Backend)backend;
+                }
+            }
+
+            report << String (1 << order).paddedRight (' ', 8)
+                   << String (FFTEngine::getBackendName (newBackends[orderIndex])).paddedRight (' ', 24);
+
+            for (int overlapIndex = 0; overlapIndex < numOverlaps; ++overlapIndex) {
+                const int overlap = 2 << overlapIndex;
+                const int candidates[] = { 0, jmax (1, (1 << order) / overlap), fixedBatchLength };
+
+                fastest = 0.0;
+                for (int candidate = 0; candidate < numElementsInArray (candidates); ++candidate) {
+                    if (thread != nullptr && thread->threadShouldExit())
+                        return {};
+
+                    //longer than the block is the whole block, already timed
+                    if (candidate > 0 && candidates[candidate] >= tuningBlockSize)
+                        continue;
+
+                    const double time = timeEngine (signal, order, overlap, candidates[candidate],
+                                                    newBackends[orderIndex], secondsPerCase);
+                    if (candidate == 0 || time < fastest) {
+                        fastest = time;
+                        newBatchLengths[orderIndex][overlapIndex] = candidates[candidate];
+                    }
+                }
+
+                report << String (newBatchLengths[orderIndex][overlapIndex]) << (overlapIndex + 1 < numOverlaps ? " / " : "\n");
+            }
+        }
+
+        {
+            const ScopedLock sl (lock);
+            std::copy (newBackends, newBackends + numOrders, backends);
+            for (int orderIndex = 0; orderIndex < numOrders; ++orderIndex)
+                std::copy (newBatchLengths[orderIndex], newBatchLengths[orderIndex] + numOverlaps, batchLengths[orderIndex]);
+            tuned = true;
+        }
+
+        if (!save())
+            report << "could not write " << getFile().getFullPathName() << "\n";
+        return report;
+    }
+
+    //from prepareToPlay: with HARMONIZER_AUTOTUNE, tunes an untuned machine once per process, off the audio and message threads
+    void tuneInBackground()
+    {
+       #if HARMONIZER_AUTOTUNE
+        const ScopedLock sl (lock);
+        if (tuned || tuner != nullptr)
+            return;
+
+        tuner = std::make_unique<Tuner> (*this);
+        tuner->startThread (Thread::Priority::low);
+       #endif
+    }
+
+    //what the timings are only valid for
+    static String getCpuSignature()
+    {
+        String features;
+        if (SystemStats::hasSSE2())    features << " sse2";
+        if (SystemStats::hasAVX())     features << " avx";
+        if (SystemStats::hasAVX2())    features << " avx2";
+        if (SystemStats::hasFMA3())    features << " fma3";
+        if (SystemStats::hasAVX512F()) features << " avx512f";
+        if (SystemStats::hasNeon())    features << " neon";
+
+        return SystemStats::getCpuVendor() + " " + SystemStats::getCpuModel() + ", "
+             + String (SystemStats::getNumPhysicalCpus()) + " cores," + features
+             + ", " + ProjectInfo::projectName + " " + ProjectInfo::versionString;
+    }
+
+    static File getFile()
+    {
+        return File::getSpecialLocation (File::userApplicationDataDirectory)
+                   .getChildFile ("Harmonizer")
+                   .getChildFile ("KernelWisdom.xml");
+    }
+
+    //options: --seconds 0.05 per timed case. prints the report, returns the exit code
+    static int tuneFromCommandLine (int argc, char* argv[])
+    {
+        double secondsPerCase = 0.05;
+        for (int i = 1; i + 1 < argc; i += 2) {
+            if (String (argv[i]) != "--seconds") {
+                std::fprintf (stderr, "unknown option %s\n", argv[i]);
+                return 2;
+            }
+            secondsPerCase = jlimit (0.001, 10.0, String (argv[i + 1]).getDoubleValue());
+        }
+
+        const String report = getInstance().tune (secondsPerCase);
+        std::fprintf (stdout, "%s", report.toRawUTF8());
+        return getInstance().isTuned() ? 0 : 1;
+    }
+
+private:
+    KernelWisdom()
+    {
+        load();
+    }
+
+    class Tuner : public Thread
+    {
+    public:
+        explicit Tuner (KernelWisdom& owner) : Thread ("Harmonizer kernel tuning"), wisdom (owner)
+        {
+        }
+
+        void run() override
+        {
+            const String report = wisdom.tune (0.05, this);
+            if (report.isNotEmpty())
+                Logger::writeToLog (report);
+        }
+
+    private:
+        KernelWisdom& wisdom;
+    };
+
+    //microseconds per block of a stereo engine shifting up a third, with the pitch given so no tracker is timed
+    static double timeEngine (const AudioBuffer<float>& signal, int order, int overlap, int batchLength, FFTEngine::Backend backend,
+                              double seconds)
+    {
+        HarmonizerEngine engine;
+        engine.setFFTFactory ([backend](int fftOrder, std::shared_ptr<const StockhamFFT::Twiddles> twiddles) {
+            return FFTEngine::create (fftOrder, backend, std::move (twiddles));
+        });
+
+        HarmonizerEngine::Config config;
+        config.sampleRate = 48000.0;
+        config.numChannels = 2;
+        config.maxBlockSize = tuningBlockSize;
+        config.batchLength = batchLength;
+        config.fftSize = 1 << order;
+        config.overlap = overlap;
+        engine.prepare (config);
+        engine.setPlayedNote (59);
+
+        AudioBuffer<float> output (2, tuningBlockSize);
+        const int numBlocks = signal.getNumSamples() / tuningBlockSize;
+        int block = 0;
+
+        return FFTBenchmark::timePairs (seconds, [&] {
+            const float* inputs[] = { signal.getReadPointer (0, block * tuningBlockSize),
+                                      signal.getReadPointer (1, block * tuningBlockSize) };
+            engine.process (inputs, output.getArrayOfWritePointers(), tuningBlockSize, { 196.0f, 1.0f });
+            block = (block + 1) % numBlocks;
+        });
+    }
+
+    static int getOrderIndex (int fftSize)
+    {
+        for (int order = minOrder; order <= maxOrder; ++order)
+            if (fftSize == 1 << order)
+                return order - minOrder;
+        return -1;
+    }
+
+    static int getOverlapIndex (int overlap)
+    {
+        return overlap == 2 ? 0 : overlap == 4 ? 1 : overlap == 8 ? 2 : -1;
+    }
+
+    //only a complete entry for this machine counts
+    void load()
+    {
+        std::unique_ptr<XmlElement> xml (parseXML (getFile()));
+        if (xml == nullptr || !xml->hasTagName ("KERNELWISDOM"))
+            return;
+
+        XmlElement* machine = xml->getChildByAttribute ("signature", getCpuSignature());
+        if (machine == nullptr)
+            return;
+
+        bool found[numOrders][numOverlaps] = {};
+        int numFound = 0;
+        for (auto* kernel : machine->getChildWithTagNameIterator ("KERNEL")) {
+            const int order = getOrderIndex (kernel->getIntAttribute ("size"));
+            const int overlapIndex = getOverlapIndex (kernel->getIntAttribute ("overlap"));
+            const int backend = kernel->getIntAttribute ("backend", -1);
+            if (order < 0 || overlapIndex < 0 || backend < 0 || backend >= FFTEngine::numBackends || found[order][overlapIndex])
+                continue;
+
+            backends[order] = (FFTEngine::Backend)backend;
+            batchLengths[order][overlapIndex] = jmax (0, kernel->getIntAttribute ("batch"));
+            found[order][overlapIndex] = true;
+            ++numFound;
+        }
+
+        tuned = numFound == numOrders * numOverlaps;
+    }
+
+    //keeps what other machines wrote, and replaces the file in one go
+    bool save() const
+    {
+        const File file = getFile();
+        std::unique_ptr<XmlElement> xml (parseXML (file));
+        if (xml == nullptr || !xml->hasTagName ("KERNELWISDOM"))
+            xml = std::make_unique<XmlElement> ("KERNELWISDOM");
+
+        const String signature = getCpuSignature();
+        if (XmlElement* previous = xml->getChildByAttribute ("signature", signature))
+            xml->removeChildElement (previous, true);
+
+        XmlElement* machine = xml->createNewChildElement ("MACHINE");
+        machine->setAttribute ("signature", signature);
+        {
+            const ScopedLock sl (lock);
+            for (int order = minOrder; order <= maxOrder; ++order) {
+                for (int overlapIndex = 0; overlapIndex < numOverlaps; ++overlapIndex) {
+                    XmlElement* kernel = machine->createNewChildElement ("KERNEL");
+                    kernel->setAttribute ("size", 1 << order);
+                    kernel->setAttribute ("overlap", 2 << overlapIndex);
+                    kernel->setAttribute ("backend", (int)backends[order - minOrder]);
+                    kernel->setAttribute ("batch", batchLengths[order - minOrder][overlapIndex]);
+                }
+            }
+        }
+
+        file.getParentDirectory().createDirectory();
+        return xml->writeTo (file);
+    }
+
+    CriticalSection lock;
+    bool tuned = false;
+    FFTEngine::Backend backends[numOrders] = {};
+    int batchLengths[numOrders][numOverlaps] = {};
+    std::unique_ptr<Tuner> tuner;
+
+    JUCE_DECLARE_NON_COPYABLE (KernelWisdom)
+};
@@ -0,0 +1,153 @@
+/*
+  ==============================================================================
+
+    McLeodPitchDetector.h
+    Author:  Sami S
+
+    McLeod pitch method [1]: normalised square difference function computed
+    through an FFT autocorrelation, so it costs O(N log N) instead of YIN's
+    O(N^2) while staying close to it in accuracy.
+
+    [1]: McLeod, P., & Wyvill, G. (2005). A smarter way to find pitch.
+            Proceedings of the International Computer Music Conference.
+
+  ==============================================================================
+*/
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "JuceFFTEngine.h"
+#include "PitchDetector.h"
+
+class McLeodPitchDetector : public PitchDetector
+{
+public:
+    void prepare (double sampleRate, int blockSize) override
+    {
+        prepareHistory (sampleRate, 44100.0, blockSize, minWindowSize);
+
+        //zero padding to twice the history turns the circular correlation into a linear one
+        const int fftOrder = (int)std::log2 (nextPowerOfTwo (2 * (int)history.size()));
+        fft = FFTEngine::create (fftOrder);
+        fftData.assign (2 * fft->getSize(), 0.0f);
+
+        //lags up to three quarters of the history, so at least a quarter of it still overlaps
+        numLags = 3 * (int)history.size() / 4;
+        nsdf.assign (numLags, 0.0f);
+
+        latest = { 0.0f, 0.0f };
+        hasNewSamples = false;
+    }
+
+    void pushSamples (const float* data, int numSamples) override
+    {
+        pushHistory (data, numSamples);
+        hasNewSamples = true;
+    }
+
+    PitchEstimate getPitch() override
+    {
+        if (hasNewSamples) {
+            latest = analyse();
+            hasNewSamples = false;
+        }
+        return latest;
+    }
+
+    //picks the first key maximum within (1 - threshold) of the highest one
+    void setThreshold (float newThreshold) override
+    {
+        cutoff = 1.0f - newThreshold;
+    }
+
+private:
+    enum { minWindowSize = 64 };
+
+    PitchEstimate analyse()
+    {
+        const int length = (int)history.size();
+
+        //autocorrelation r(tau) through the power spectrum
+        std::fill (fftData.begin(), fftData.end(), 0.0f);
+        std::copy (history.begin(), history.end(), fftData.begin());
+        fft->performRealOnlyForwardTransform (fftData.data());
+        for (int bin = 0; bin < fft->getSize(); ++bin) {
+            const float re = fftData[2 * bin];
+            const float im = fftData[2 * bin + 1];
+            fftData[2 * bin] = re * re + im * im;
+            fftData[2 * bin + 1] = 0.0f;
+        }
+        fft->performRealOnlyInverseTransform (fftData.data());
+
+        //m(tau) = sum of x[j]^2 + x[j + tau]^2, updated incrementally from m(0) = 2 r(0)
+        float energy = 0.0f;
+        for (int i = 0; i < length; ++i)
+            energy += history[i] * history[i];
+        if (energy <= 0.0f || fftData[0] <= 0.0f)
+            return { 0.0f, 0.0f };
+
+        //whatever scaling the inverse transform applies, r(0) has to match the energy
+        const float scale = energy / fftData[0];
+        float m = 2.0f * energy;
+        for (int tau = 0; tau < numLags; ++tau) {
+            if (tau > 0)
+                m -= history[tau - 1] * history[tau - 1] + history[length - tau] * history[length - tau];
+            nsdf[tau] = m > 0.0f ? 2.0f * scale * fftData[tau] / m : 0.0f;
+        }
+
+        //key maxima: the highest point of each positive lobe after the first negative zero crossing
+        int numMaxima = 0;
+        int maxima[maxNumMaxima];
+        float highest = 0.0f;
+
+        int tau = 1;
+        while (tau < numLags && nsdf[tau] > 0.0f)
+            ++tau;
+
+        while (tau < numLags && numMaxima < maxNumMaxima) {
+            while (tau < numLags && nsdf[tau] <= 0.0f)
+                ++tau;
+            if (tau >= numLags)
+                break;
+
+            int peak = tau;
+            while (tau < numLags && nsdf[tau] > 0.0f) {
+                if (nsdf[tau] > nsdf[peak])
+                    peak = tau;
+                ++tau;
+            }
+
+            //a lobe still rising at the last lag has no maximum yet
+            if (peak >= numLags - 1)
+                break;
+
+            maxima[numMaxima++] = peak;
+            highest = std::max (highest, nsdf[peak]);
+        }
+
+        if (numMaxima == 0 || highest < minClarity)
+            return { 0.0f, 0.0f };
+
+        for (int i = 0; i < numMaxima; ++i) {
+            if (nsdf[maxima[i]] >= cutoff * highest) {
+                const float period = parabolicVertex (nsdf.data(), maxima[i], numLags);
+                return { (float)(decimatedRate / (double)period), jlimit (0.0f, 1.0f, nsdf[maxima[i]]) };
+            }
+        }
+
+        return { 0.0f, 0.0f };
+    }
+
+    enum { maxNumMaxima = 64 };
+    //below this the window is treated as unvoiced
+    static constexpr float minClarity = 0.5f;
+
+    std::unique_ptr<FFTEngine> fft;
+    std::vector<float> fftData;
+    std::vector<float> nsdf;
+    int numLags = 0;
+
+    float cutoff = 0.9f;
+    PitchEstimate latest { 0.0f, 0.0f };
+    bool hasNewSamples = false;
+};
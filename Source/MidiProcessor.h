@@ -41,10 +41,19 @@ public:
 				DBG("Note On: " << noteNumber << " " << frequency << " Hz");
 
 			}
+			else if (currentMessage.isNoteOff() && currentMessage.getNoteNumber() == this->midiNumber)
+			{
+				//releasing the held note leaves nothing to shift to
+				this->midiNumber = -1;
+				this->frequency = 0.0f;
+
+				DBG("Note Off: " << currentMessage.getNoteNumber());
+			}
 		}
 	}
 
-	int midiNumber;
-	float frequency;
+	//-1 while no note is held
+	int midiNumber = -1;
+	float frequency = 0.0f;
 	MidiKeyboardState keyboardState;
 };
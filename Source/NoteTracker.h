@@ -0,0 +1,137 @@
+/*
+  ==============================================================================
+
+    NoteTracker.h
+    Author:  Sami S
+
+    Turns the per block pitch estimates into the note the voice is singing.
+    Rounding every estimate flickers between neighbouring notes on breathy
+    or vibrato-heavy vocals, and each flicker restarts the vocoder phases.
+    Here estimates below a confidence go in as unvoiced, voiced ones are
+    median filtered over the last few blocks, the current note is kept
+    while the pitch stays within a hysteresis band around it, and a new
+    note (or unvoiced) has to hold for a minimum duration before it takes
+    over. Plain C++, part of the DSP core.
+
+  ==============================================================================
+*/
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include "PitchDetector.h"
+
+class NoteTracker
+{
+public:
+    enum { medianLength = 5 };
+
+    void prepare (double newSampleRate)
+    {
+        sampleRate = newSampleRate;
+        updateMinNoteSamples();
+        reset();
+    }
+
+    void reset()
+    {
+        currentNote = -1;
+        pendingNote = -1;
+        pendingSamples = 0;
+        numHistory = 0;
+        historyPosition = 0;
+    }
+
+    //confidence from 0 to 1, hysteresis in semitones past the half way point to the next note
+    void setParameters (float newMinConfidence, float newHysteresis, float newMinNoteMs)
+    {
+        minConfidence = newMinConfidence;
+        hysteresis = newHysteresis;
+        if (newMinNoteMs != minNoteMs) {
+            minNoteMs = newMinNoteMs;
+            updateMinNoteSamples();
+        }
+    }
+
+    //realtime safe, the note for a block of numSamples with this estimate, -1 while unvoiced
+    int update (PitchEstimate estimate, int numSamples)
+    {
+        const bool voiced = estimate.frequency > 0.0f && estimate.confidence >= minConfidence;
+        int candidate = -1;
+
+        if (voiced) {
+            history[historyPosition] = 12.0f * std::log2 (estimate.frequency / 440.0f) + 69.0f;
+            historyPosition = (historyPosition + 1) % medianLength;
+            numHistory = std::min (numHistory + 1, (int)medianLength);
+
+            //the current note holds until the pitch is clearly nearer another one
+            const float pitch = getMedian();
+            candidate = currentNote >= 0 && std::abs (pitch - (float)currentNote) < 0.5f + hysteresis
+                      ? currentNote
+                      : (int)std::round (pitch);
+        }
+        else {
+            //a new voiced stretch does not inherit the medians of the last one
+            numHistory = 0;
+            historyPosition = 0;
+        }
+
+        if (candidate == currentNote) {
+            pendingSamples = 0;
+            return currentNote;
+        }
+
+        if (candidate != pendingNote) {
+            pendingNote = candidate;
+            pendingSamples = 0;
+        }
+
+        pendingSamples += numSamples;
+        if (pendingSamples >= minNoteSamples) {
+            currentNote = pendingNote;
+            pendingSamples = 0;
+        }
+        return currentNote;
+    }
+
+    int getCurrentNote() const { return currentNote; }
+
+private:
+    float getMedian() const
+    {
+        const int count = std::max (0, std::min (numHistory, (int)medianLength));
+        if (count == 0)
+            return 0.0f;
+
+        //an insertion sort of at most medianLength values. std::sort's unrolled insertion sort makes gcc
+        //warn about indices up to 16 in this array
+        float sorted[medianLength];
+        for (int index = 0; index < count; ++index) {
+            int position = index;
+            for (; position > 0 && sorted[position - 1] > history[index]; --position)
+                sorted[position] = sorted[position - 1];
+            sorted[position] = history[index];
+        }
+        return count % 2 != 0 ? sorted[count / 2] : 0.5f * (sorted[count / 2 - 1] + sorted[count / 2]);
+    }
+
+    void updateMinNoteSamples()
+    {
+        minNoteSamples = (int)(minNoteMs * 1e-3 * sampleRate);
+    }
+
+    double sampleRate = 44100.0;
+    float minConfidence = 0.5f;
+    float hysteresis = 0.25f;
+    float minNoteMs = 50.0f;
+    int minNoteSamples = 2205;
+
+    int currentNote = -1;
+    int pendingNote = -1;
+    int pendingSamples = 0;
+
+    //fractional midi notes of the latest voiced blocks
+    float history[medianLength] = {};
+    int numHistory = 0;
+    int historyPosition = 0;
+};
@@ -0,0 +1,304 @@
+/*
+  ==============================================================================
+
+    PcmStream.h
+    Author:  Sami S
+
+    Runs the processor as a filter in a pipeline (sox | harmonizer | encoder):
+    interleaved raw PCM comes in on stdin and goes out on stdout in the same
+    format, so no temporary files are needed. The format is not negotiated
+    with anything, the command line gives it:
+
+        --rate 44100      sample rate in Hz
+        --channels 1      interleaved channels
+        --format f32      f32 (native float) or s16 (native 16 bit)
+        --block 4096      frames read, processed and written at a time
+        --midi notes.txt  MIDI to play, a .mid file or a text file of
+                          "<seconds> on <note> [velocity]" and
+                          "<seconds> off <note>" lines ('#' starts a comment)
+
+    Everything is allocated before the first chunk, so memory stays bounded
+    by the block size whatever the length of the stream. The output is
+    shifted back by the processor's latency and padded at the end, so it
+    lines up with the input sample for sample.
+
+    CommandLineMain.cpp has the entry point for a console target built with
+    HARMONIZER_COMMAND_LINE_MAIN=1. The plugin compiles that file as well,
+    so this header is built with every change to the processor.
+
+  ==============================================================================
+*/
+#pragma once
+
+#include <cstdio>
+#if JUCE_WINDOWS
+ #include <fcntl.h>
+ #include <io.h>
+#endif
+#include "../JuceLibraryCode/JuceHeader.h"
+
+class PcmStream
+{
+public:
+    enum SampleFormat {
+        formatFloat32 = 0,
+        formatInt16,
+    };
+
+    struct Options
+    {
+        double sampleRate = 44100.0;
+        int numChannels = 1;
+        int sampleFormat = formatFloat32;
+        int blockSize = 4096;
+        File midiFile;
+    };
+
+    //returns an empty string on success, or what is wrong with the arguments
+    static String parseArguments (const StringArray& args, Options& options)
+    {
+        for (int i = 0; i < args.size(); ++i) {
+            const String& flag = args[i];
+            if (!flag.startsWith ("--"))
+                return "unexpected argument " + flag;
+            if (i + 1 >= args.size())
+                return "missing value for " + flag;
+
+            const String value = args[++i];
+            if (flag == "--rate")
+                options.sampleRate = value.getDoubleValue();
+            else if (flag == "--channels")
+                options.numChannels = value.getIntValue();
+            else if (flag == "--block")
+                options.blockSize = value.getIntValue();
+            else if (flag == "--midi")
+                options.midiFile = File::getCurrentWorkingDirectory().getChildFile (value);
+            else if (flag == "--format" && value == "f32")
+                options.sampleFormat = formatFloat32;
+            else if (flag == "--format" && value == "s16")
+                options.sampleFormat = formatInt16;
+            else
+                return "unknown option " + flag + " " + value;
+        }
+
+        if (options.sampleRate < 8000.0 || options.sampleRate > 384000.0)
+            return "sample rate out of range";
+        if (options.numChannels < 1 || options.numChannels > 32)
+            return "channel count out of range";
+        if (options.blockSize < 32 || options.blockSize > 65536)
+            return "block size out of range";
+        if (options.midiFile != File() && !options.midiFile.existsAsFile())
+            return "cannot open " + options.midiFile.getFullPathName();
+
+        return {};
+    }
+
+    //.mid files keep their own tempo map, text files are in seconds. sorted, with matched note offs
+    static bool loadMidi (const File& file, double sampleRate, MidiMessageSequence& sequence)
+    {
+        sequence.clear();
+        if (file == File())
+            return true;
+
+        if (file.hasFileExtension ("mid;midi")) {
+            FileInputStream stream (file);
+            MidiFile midiFile;
+            if (!stream.openedOk() || !midiFile.readFrom (stream))
+                return false;
+
+            midiFile.convertTimestampTicksToSeconds();
+            for (int track = 0; track < midiFile.getNumTracks(); ++track)
+                sequence.addSequence (*midiFile.getTrack (track), 0.0);
+        }
+        else {
+            StringArray lines;
+            lines.addLines (file.loadFileAsString());
+
+            for (auto line : lines) {
+                line = line.upToFirstOccurrenceOf ("#", false, false).trim();
+                if (line.isEmpty())
+                    continue;
+
+                StringArray tokens;
+                tokens.addTokens (line, " \t", {});
+                tokens.removeEmptyStrings();
+                if (tokens.size() < 3)
+                    return false;
+
+                const double time = tokens[0].getDoubleValue();
+                const int note = jlimit (0, 127, tokens[2].getIntValue());
+                if (tokens[1] == "on")
+                    sequence.addEvent (MidiMessage::noteOn (1, note, (uint8)(tokens.size() > 3 ? jlimit (1, 127, tokens[3].getIntValue()) : 100)), time);
+                else if (tokens[1] == "off")
+                    sequence.addEvent (MidiMessage::noteOff (1, note), time);
+                else
+                    return false;
+            }
+        }
+
+        //from seconds to samples from the start of the stream
+        for (int i = 0; i < sequence.getNumEvents(); ++i) {
+            auto& message = sequence.getEventPointer (i)->message;
+            message.setTimeStamp (std::round (message.getTimeStamp() * sampleRate));
+        }
+
+        sequence.sort();
+        sequence.updateMatchedPairs();
+        return true;
+    }
+
+    //stdin to stdout with the options of argv, returns the exit code
+    static int runFromCommandLine (AudioProcessor& processor, int argc, char* argv[])
+    {
+        StringArray args;
+        for (int i = 1; i < argc; ++i)
+            args.add (String::fromUTF8 (argv[i]));
+
+        Options options;
+        const String error = parseArguments (args, options);
+        if (error.isNotEmpty()) {
+            std::fprintf (stderr, "%s\n", error.toRawUTF8());
+            return 2;
+        }
+
+       #if JUCE_WINDOWS
+        //no newline translation on binary pipes
+        _setmode (_fileno (stdin), _O_BINARY);
+        _setmode (_fileno (stdout), _O_BINARY);
+       #endif
+
+        if (!run (processor, options, stdin, stdout)) {
+            std::fprintf (stderr, "stream failed\n");
+            return 1;
+        }
+        return 0;
+    }
+
+    //processes until the input ends, returns false if reading or writing failed
+    static bool run (AudioProcessor& processor, const Options& options, std::FILE* input, std::FILE* output)
+    {
+        MidiMessageSequence sequence;
+        if (!loadMidi (options.midiFile, options.sampleRate, sequence))
+            return false;
+
+        const int numChannels = options.numChannels;
+        const int blockSize = options.blockSize;
+        const size_t bytesPerSample = options.sampleFormat == formatInt16 ? sizeof (int16) : sizeof (float);
+        const size_t bytesPerFrame = bytesPerSample * (size_t)numChannels;
+
+        processor.setPlayConfigDetails (numChannels, numChannels, options.sampleRate, blockSize);
+        processor.setNonRealtime (true);
+        processor.prepareToPlay (options.sampleRate, blockSize);
+
+        HeapBlock<char> bytes ((size_t)blockSize * bytesPerFrame);
+        AudioBuffer<float> buffer (jmax (numChannels, processor.getTotalNumOutputChannels()), blockSize);
+        MidiBuffer midi;
+        midi.ensureSize ((size_t)sequence.getNumEvents() * 8 + 256);
+
+        int64 inputPosition = 0;
+        int64 latencyToSkip = processor.getLatencySamples();
+        int64 tailToFlush = latencyToSkip;
+        int nextEvent = 0;
+        bool ok = true;
+
+        while (ok) {
+            int numFrames = (int)readFully (bytes.getData(), bytesPerFrame, (size_t)blockSize, input);
+            const bool endOfInput = numFrames < blockSize;
+            if (numFrames == 0 && tailToFlush == 0)
+                break;
+
+            buffer.clear();
+            readSamples (bytes.getData(), options.sampleFormat, buffer, numChannels, numFrames);
+
+            //after the input ends, silence pushes out what is still in the processor
+            if (endOfInput) {
+                const int tail = (int)jmin ((int64)(blockSize - numFrames), tailToFlush);
+                tailToFlush -= tail;
+                numFrames += tail;
+            }
+            if (numFrames == 0)
+                break;
+
+            midi.clear();
+            while (nextEvent < sequence.getNumEvents()) {
+                const auto& message = sequence.getEventPointer (nextEvent)->message;
+                const int64 time = (int64)message.getTimeStamp();
+                if (time >= inputPosition + numFrames)
+                    break;
+                midi.addEvent (message, (int)jmax ((int64)0, time - inputPosition));
+                ++nextEvent;
+            }
+
+            AudioBuffer<float> block (buffer.getArrayOfWritePointers(), buffer.getNumChannels(), numFrames);
+            processor.processBlock (block, midi);
+            inputPosition += numFrames;
+
+            //the first latency samples are what the processor held before the stream started
+            const int skip = (int)jmin ((int64)numFrames, latencyToSkip);
+            latencyToSkip -= skip;
+
+            const int numToWrite = numFrames - skip;
+            writeSamples (buffer, skip, numChannels, numToWrite, options.sampleFormat, bytes.getData());
+            ok = std::fwrite (bytes.getData(), bytesPerFrame, (size_t)numToWrite, output) == (size_t)numToWrite;
+
+            if (endOfInput && tailToFlush == 0)
+                break;
+        }
+
+        processor.releaseResources();
+        return ok && std::fflush (output) == 0 && !std::ferror (input);
+    }
+
+private:
+    //a pipe hands over whatever it has, keep reading until the block is full or the stream ends
+    static size_t readFully (char* data, size_t frameSize, size_t numFrames, std::FILE* input)
+    {
+        const size_t total = frameSize * numFrames;
+        size_t done = 0;
+        while (done < total) {
+            const size_t numRead = std::fread (data + done, 1, total - done, input);
+            if (numRead == 0)
+                break;
+            done += numRead;
+        }
+
+        //a trailing partial frame is dropped
+        return done / frameSize;
+    }
+
+    static void readSamples (const char* data, int sampleFormat, AudioBuffer<float>& buffer, int numChannels, int numFrames)
+    {
+        for (int channel = 0; channel < numChannels; ++channel) {
+            float* samples = buffer.getWritePointer (channel);
+
+            if (sampleFormat == formatInt16) {
+                const int16* source = reinterpret_cast<const int16*> (data) + channel;
+                for (int frame = 0; frame < numFrames; ++frame)
+                    samples[frame] = (float)source[frame * numChannels] * (1.0f / 32768.0f);
+            }
+            else {
+                const float* source = reinterpret_cast<const float*> (data) + channel;
+                for (int frame = 0; frame < numFrames; ++frame)
+                    samples[frame] = source[frame * numChannels];
+            }
+        }
+    }
+
+    static void writeSamples (const AudioBuffer<float>& buffer, int start, int numChannels, int numFrames, int sampleFormat, char* data)
+    {
+        for (int channel = 0; channel < numChannels; ++channel) {
+            const float* samples = buffer.getReadPointer (channel, start);
+
+            if (sampleFormat == formatInt16) {
+                int16* destination = reinterpret_cast<int16*> (data) + channel;
+                for (int frame = 0; frame < numFrames; ++frame)
+                    destination[frame * numChannels] = (int16)jlimit (-32768.0f, 32767.0f, std::round (samples[frame] * 32768.0f));
+            }
+            else {
+                float* destination = reinterpret_cast<float*> (data) + channel;
+                for (int frame = 0; frame < numFrames; ++frame)
+                    destination[frame * numChannels] = samples[frame];
+            }
+        }
+    }
+};
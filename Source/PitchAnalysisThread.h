@@ -0,0 +1,203 @@
+/*
+  ==============================================================================
+
+    PitchAnalysisThread.h
+    Author:  Sami S
+
+    Runs the pitch tracker on a low priority worker instead of the audio thread.
+    The audio thread pushes channel 0 into a single producer single consumer
+    ring and reads back the latest result, neither side ever waits on the other.
+    A worker that falls a whole ring behind loses the oldest samples rather
+    than the newest, since the tracker only needs the latest window.
+    The worker wakes up every lag milliseconds, so results are at most that
+    (plus the tracker window) behind the audio. With nothing pushed (async
+    tracking off) it parks on its event until the next push wakes it, so
+    idle instances cost no wakeups.
+
+  ==============================================================================
+*/
+#pragma once
+
+#include <atomic>
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "PitchDetector.h"
+
+class PitchAnalysisThread : public Thread
+{
+public:
+    PitchAnalysisThread() : Thread ("Pitch analysis")
+    {
+    }
+
+    ~PitchAnalysisThread()
+    {
+        stopThread (1000);
+    }
+
+    //not realtime safe, call from prepareToPlay
+    void prepare (double newSampleRate, int blockSize)
+    {
+        stopThread (1000);
+
+        sampleRate = newSampleRate;
+        preparedBlockSize = blockSize;
+        for (auto* detector : detectors) {
+            detector->prepare (sampleRate, blockSize);
+            detector->setThreshold (threshold.load());
+        }
+
+        //room for the longest lag plus a few blocks in case the worker gets descheduled
+        ringSize = nextPowerOfTwo ((int)(maxLag * 1e-3 * sampleRate) + 4 * blockSize);
+        samples.setSize (1, ringSize);
+        samples.clear();
+        workerSamples.setSize (1, ringSize);
+
+        pushedSamples = 0;
+        analysedSamples = 0;
+        latest.store ({ 0.0f, 0.0f });
+        parked = false;
+
+        startThread (Thread::Priority::low);
+    }
+
+    void release()
+    {
+        stopThread (1000);
+    }
+
+    //audio thread: always written, over the oldest samples when the worker is a ring behind. published a block at
+    //most at a time, so a write in flight is never more than a block past what the worker sees as pushed
+    void pushSamples (const float* data, int numSamples)
+    {
+        while (numSamples > 0) {
+            const int numToWrite = jmin (numSamples, preparedBlockSize);
+            const int64 position = pushedSamples.load (std::memory_order_relaxed);
+            const int start = (int)(position % ringSize);
+            const int size1 = jmin (numToWrite, ringSize - start);
+            samples.copyFrom (0, start, data, size1);
+            if (numToWrite > size1)
+                samples.copyFrom (0, 0, data + size1, numToWrite - size1);
+            pushedSamples.store (position + numToWrite, std::memory_order_release);
+
+            data += numToWrite;
+            numSamples -= numToWrite;
+        }
+
+        //only the first push after the worker parked signals it
+        if (parked.exchange (false))
+            notify();
+    }
+
+    PitchEstimate getLatestResult() const
+    {
+        return latest.load();
+    }
+
+    //samples pushed by the audio thread that the latest result does not cover yet
+    int64 getLagSamples() const
+    {
+        return pushedSamples.load() - analysedSamples.load();
+    }
+
+    void setLag (float lagMs)
+    {
+        lag.store (jlimit (1.0f, (float)maxLag, lagMs));
+    }
+
+    void setThreshold (float newThreshold)
+    {
+        threshold.store (newThreshold);
+    }
+
+    //audio thread: what is pushed from now on does not follow what was, the worker prepares its tracker again
+    void restart()
+    {
+        ++restarts;
+    }
+
+    //switching trackers starts the new one from an empty history, the worker prepares it again
+    void setDetector (int index)
+    {
+        detectorIndex.store (jlimit (0, detectors.size() - 1, index));
+    }
+
+    void run() override
+    {
+        float currentThreshold = threshold.load();
+        int currentIndex = detectorIndex.load();
+        int currentRestarts = restarts.load();
+
+        while (!threadShouldExit()) {
+            wait ((int)lag.load());
+
+            if (getLagSamples() == 0) {
+                //parked is set before looking again, so a push in between signals and the wait returns at once
+                parked = true;
+                if (getLagSamples() == 0) {
+                    wait (-1);
+                    continue;
+                }
+                parked = false;
+            }
+
+            if (currentThreshold != threshold.load()) {
+                currentThreshold = threshold.load();
+                for (auto* detector : detectors)
+                    detector->setThreshold (currentThreshold);
+            }
+
+            PitchDetector* detector = detectors[detectorIndex.load()];
+            if (currentIndex != detectorIndex.load() || currentRestarts != restarts.load()) {
+                currentIndex = detectorIndex.load();
+                currentRestarts = restarts.load();
+                detector = detectors[currentIndex];
+                detector->prepare (sampleRate, preparedBlockSize);
+                detector->setThreshold (currentThreshold);
+            }
+
+            //everything still in the ring goes through the tracker history but only the latest window is analysed
+            const int64 end = pushedSamples.load (std::memory_order_acquire);
+            const int64 start = jmax (analysedSamples.load(), end - ringSize);
+            const int numToRead = (int)(end - start);
+            const int ringStart = (int)(start % ringSize);
+            const int size1 = jmin (numToRead, ringSize - ringStart);
+            workerSamples.copyFrom (0, 0, samples, 0, ringStart, size1);
+            if (numToRead > size1)
+                workerSamples.copyFrom (0, size1, samples, 0, 0, numToRead - size1);
+
+            //the copy's front may have been written over while it was made, a block past the pushed ones at most
+            const int64 oldestIntact = pushedSamples.load (std::memory_order_acquire) - ringSize + preparedBlockSize;
+            const int numOverwritten = (int)jlimit ((int64)0, (int64)numToRead, oldestIntact - start);
+            if (numToRead > numOverwritten)
+                detector->pushSamples (workerSamples.getReadPointer (0, numOverwritten), numToRead - numOverwritten);
+
+            latest.store (detector->getPitch());
+            analysedSamples = end;
+        }
+    }
+
+    enum { maxLag = 100 };
+
+    //the worker's own trackers, filled by the owner before the first prepare
+    OwnedArray<PitchDetector> detectors;
+
+private:
+    double sampleRate = 44100.0;
+    int preparedBlockSize = 512;
+
+    //written by the audio thread at pushedSamples modulo ringSize, copied out by the worker
+    int ringSize = 1;
+    AudioSampleBuffer samples;
+    AudioSampleBuffer workerSamples;
+
+    std::atomic<PitchEstimate> latest { PitchEstimate { 0.0f, 0.0f } };
+    std::atomic<int64> pushedSamples { 0 };
+    std::atomic<int64> analysedSamples { 0 };
+    std::atomic<float> lag { 20.0f };
+    std::atomic<float> threshold { 0.1f };
+    std::atomic<int> detectorIndex { 0 };
+    std::atomic<int> restarts { 0 };
+    std::atomic<bool> parked { false };
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (PitchAnalysisThread)
+};
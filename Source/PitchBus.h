@@ -0,0 +1,156 @@
+/*
+  ==============================================================================
+
+    PitchBus.h
+    Author:  Sami S
+
+    Pitch results shared between instances in the same process, so several
+    instances harmonizing against one guide track do not each run a tracker
+    on the same audio. One instance sends what it tracked for every block,
+    keyed by the host's sample position, the others receive the result of
+    the block they are processing instead of tracking themselves. Hosts may
+    run the sender after a receiver or on another core, so a receiver falls
+    back to the newest result when its own block is not in yet, and gets
+    nothing once the sender has been quiet for a while. A bus has a single
+    sender: the first instance to send owns it, and a second one is refused
+    until the owner has been quiet for that long too (removed, or sending
+    to another bus).
+
+    Each bus is a ring of results under a sequence lock per entry. Sending
+    and receiving never wait or allocate. Plain C++.
+
+  ==============================================================================
+*/
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include "PitchDetector.h"
+
+class PitchBus
+{
+public:
+    enum {
+        numBuses = 4,
+        historyLength = 64,
+        //a sender quiet for longer than this is gone
+        timeoutMs = 500,
+    };
+
+    static PitchBus& get (int index)
+    {
+        static PitchBus buses[numBuses];
+        return buses[index];
+    }
+
+    //audio thread of the sender, identified by any pointer of its own. false when another sender owns the bus
+    bool send (const void* sender, int64_t startSample, int numSamples, PitchEstimate estimate)
+    {
+        const int64_t nowMs = getNowMs();
+        const void* currentOwner = owner.load (std::memory_order_acquire);
+        if (currentOwner != sender) {
+            if (currentOwner != nullptr && nowMs - lastSendMs.load (std::memory_order_relaxed) <= timeoutMs)
+                return false;
+            //of two senders taking over a quiet bus at once only one wins
+            if (!owner.compare_exchange_strong (currentOwner, sender, std::memory_order_acq_rel))
+                return false;
+        }
+        lastSendMs.store (nowMs, std::memory_order_relaxed);
+
+        //the slot is claimed rather than read and written back, so an old owner still finishing a send cannot take it too
+        const uint64_t index = claimCount.fetch_add (1, std::memory_order_relaxed);
+        Entry& entry = entries[index % historyLength];
+
+        const uint64_t sequence = entry.sequence.load (std::memory_order_relaxed);
+        entry.sequence.store (sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence (std::memory_order_release);
+
+        entry.startSample.store (startSample, std::memory_order_relaxed);
+        entry.numSamples.store (numSamples, std::memory_order_relaxed);
+        entry.frequency.store (estimate.frequency, std::memory_order_relaxed);
+        entry.confidence.store (estimate.confidence, std::memory_order_relaxed);
+        entry.sentMs.store (nowMs, std::memory_order_relaxed);
+
+        entry.sequence.store (sequence + 2, std::memory_order_release);
+
+        //receivers only see written entries, the count never moves back when a later claim finished first
+        uint64_t published = writeCount.load (std::memory_order_relaxed);
+        while (published < index + 1
+               && !writeCount.compare_exchange_weak (published, index + 1, std::memory_order_release, std::memory_order_relaxed)) {
+        }
+        return true;
+    }
+
+    //audio thread of a receiver: the result of the block that covers startSample, else the newest one.
+    //false when nothing was sent within the timeout
+    bool receive (int64_t startSample, PitchEstimate& estimate) const
+    {
+        const uint64_t count = writeCount.load (std::memory_order_acquire);
+        if (count == 0)
+            return false;
+
+        Result newest;
+        if (!read (entries[(count - 1) % historyLength], newest) || getNowMs() - newest.sentMs > timeoutMs)
+            return false;
+
+        estimate = newest.estimate;
+        const uint64_t numEntries = count < (uint64_t)historyLength ? count : (uint64_t)historyLength;
+        for (uint64_t back = 1; back <= numEntries; ++back) {
+            Result result;
+            if (read (entries[(count - back) % historyLength], result)
+                && startSample >= result.startSample && startSample < result.startSample + result.numSamples) {
+                estimate = result.estimate;
+                break;
+            }
+        }
+        return true;
+    }
+
+private:
+    struct Entry
+    {
+        //odd while the sender writes it
+        std::atomic<uint64_t> sequence { 0 };
+        std::atomic<int64_t> startSample { 0 };
+        std::atomic<int> numSamples { 0 };
+        std::atomic<float> frequency { 0.0f };
+        std::atomic<float> confidence { 0.0f };
+        std::atomic<int64_t> sentMs { 0 };
+    };
+
+    struct Result
+    {
+        int64_t startSample = 0;
+        int numSamples = 0;
+        PitchEstimate estimate { 0.0f, 0.0f };
+        int64_t sentMs = 0;
+    };
+
+    //false if the entry was being written, the reader then treats it as missing rather than waiting
+    static bool read (const Entry& entry, Result& result)
+    {
+        const uint64_t before = entry.sequence.load (std::memory_order_acquire);
+        if ((before & 1) != 0)
+            return false;
+
+        result.startSample = entry.startSample.load (std::memory_order_relaxed);
+        result.numSamples = entry.numSamples.load (std::memory_order_relaxed);
+        result.estimate = { entry.frequency.load (std::memory_order_relaxed), entry.confidence.load (std::memory_order_relaxed) };
+        result.sentMs = entry.sentMs.load (std::memory_order_relaxed);
+
+        std::atomic_thread_fence (std::memory_order_acquire);
+        return entry.sequence.load (std::memory_order_relaxed) == before;
+    }
+
+    static int64_t getNowMs()
+    {
+        return std::chrono::duration_cast<std::chrono::milliseconds> (std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    Entry entries[historyLength];
+    std::atomic<uint64_t> claimCount { 0 };
+    std::atomic<uint64_t> writeCount { 0 };
+    std::atomic<const void*> owner { nullptr };
+    std::atomic<int64_t> lastSendMs { 0 };
+};
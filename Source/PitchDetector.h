@@ -0,0 +1,106 @@
+/*
+  ==============================================================================
+
+    PitchDetector.h
+    Author:  Sami S
+
+    Common interface for the pitch trackers, so the processor (and the async
+    worker) can swap between trackers of different cost and accuracy. A tracker
+    is prepared once, fed the latest samples of the analysed channel and asked
+    for the pitch of its latest window.
+
+  ==============================================================================
+*/
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include "HalfBandDecimator.h"
+
+struct PitchEstimate
+{
+    //0 when no pitch was found
+    float frequency;
+    //0 to 1
+    float confidence;
+};
+
+class PitchDetector
+{
+public:
+    virtual ~PitchDetector() = default;
+
+    virtual void prepare (double sampleRate, int blockSize) = 0;
+    virtual void pushSamples (const float* data, int numSamples) = 0;
+    //pitch of the latest pushed window
+    virtual PitchEstimate getPitch() = 0;
+    //0.1 (strict) to 0.4 (permissive), each tracker maps it to its own detection threshold
+    virtual void setThreshold (float newThreshold) = 0;
+
+    //trackers that work on the vocoder's analysis frames of channel 0 rather than on samples
+    virtual bool usesAnalysisFrames() const { return false; }
+    //magnitudes and phase advances (radians over one hop) of the fftSize bins of an analysis frame
+    virtual void analyseFrame (const float* /*magnitudes*/, const float* /*phaseAdvances*/, int /*fftSize*/, int /*hopSize*/) {}
+
+    static int frequencyToMidi (float frequency)
+    {
+        if (frequency <= 0.0f)
+            return -1;
+        return (int)std::round (12.0f * std::log2 (frequency / 440.0f) + 69.0f);
+    }
+
+protected:
+    //decimated history shared by the trackers that work on their own copy of the input
+    void prepareHistory (double sampleRate, double trackingRate, int blockSize, int minWindowSize)
+    {
+        decimator.prepare (HalfBandDecimator::getNumStages (sampleRate, trackingRate));
+        decimationFactor = decimator.getFactor();
+        decimatedRate = sampleRate / (double)decimationFactor;
+
+        //same time span as YIN: twice the block, lags up to one block
+        windowSize = std::max (minWindowSize, blockSize / decimationFactor);
+        history.assign (2 * windowSize, 0.0f);
+        decimated.assign (blockSize, 0.0f);
+    }
+
+    void pushHistory (const float* data, int numSamples)
+    {
+        while (numSamples > 0) {
+            const int numToDecimate = std::min (numSamples, (int)decimated.size());
+            const int numDecimated = decimator.process (data, decimated.data(), numToDecimate);
+
+            const int length = (int)history.size();
+            if (numDecimated >= length) {
+                std::copy (decimated.begin() + numDecimated - length, decimated.begin() + numDecimated, history.begin());
+            }
+            else {
+                std::copy (history.begin() + numDecimated, history.end(), history.begin());
+                std::copy (decimated.begin(), decimated.begin() + numDecimated, history.end() - numDecimated);
+            }
+
+            data += numToDecimate;
+            numSamples -= numToDecimate;
+        }
+    }
+
+    //abscissa of the vertex of the parabola through pos - 1, pos and pos + 1
+    static float parabolicVertex (const float* data, int pos, int size)
+    {
+        if (pos <= 0 || pos >= size - 1)
+            return (float)pos;
+
+        const float s0 = data[pos - 1], s1 = data[pos], s2 = data[pos + 1];
+        const float denominator = s0 - 2.0f * s1 + s2;
+        if (denominator == 0.0f)
+            return (float)pos;
+        return (float)pos + 0.5f * (s0 - s2) / denominator;
+    }
+
+    HalfBandDecimator decimator;
+    int decimationFactor = 1;
+    double decimatedRate = 44100.0;
+    int windowSize = 0;
+    std::vector<float> history;
+    std::vector<float> decimated;
+};
@@ -52,6 +52,8 @@ PitchShiftAudioProcessorEditor::PitchShiftAudioProcessorEditor (HarmonizerAudioP
                 aComboBox->setEditableText (false);
                 aComboBox->setJustificationType (Justification::left);
                 aComboBox->addItemList (processor.parameters.comboBoxItemLists[comboBoxCounter++], 1);
+                //read-only parameters only display what the processor sets
+                aComboBox->setEnabled (parameter->isAutomatable());
 
                 ComboBoxAttachment* aComboBoxAttachment;
                 comboBoxAttachments.add (aComboBoxAttachment =
@@ -77,11 +79,18 @@ PitchShiftAudioProcessorEditor::PitchShiftAudioProcessorEditor (HarmonizerAudioP
     //======================================
 
     editorHeight += components.size() * editorPadding;
+    editorHeight += displayHeight + editorPadding;
     setSize (editorWidth, editorHeight);
+
+    //the audio thread only feeds the display while this editor is open
+    processor.visualisationFeed.setActive (true);
+    startTimerHz (displayRefreshRate);
 }
 
 PitchShiftAudioProcessorEditor::~PitchShiftAudioProcessorEditor()
 {
+    stopTimer();
+    processor.visualisationFeed.setActive (false);
 }
 
 //==============================================================================
@@ -89,6 +98,111 @@ PitchShiftAudioProcessorEditor::~PitchShiftAudioProcessorEditor()
 void PitchShiftAudioProcessorEditor::paint (Graphics& g)
 {
     g.fillAll (getLookAndFeel().findColour (ResizableWindow::backgroundColourId));
+
+    Rectangle<float> bounds = displayBounds.toFloat();
+    g.setColour (Colours::black);
+    g.fillRect (bounds);
+
+    paintSpectrum (g, bounds.removeFromTop (bounds.getHeight() * 0.5f).reduced (2.0f));
+    paintPitchTrace (g, bounds.reduced (2.0f));
+}
+
+//log frequency bands, level from the feed's floor up to 0 dB
+void PitchShiftAudioProcessorEditor::paintSpectrum (Graphics& g, Rectangle<float> bounds)
+{
+    if (!hasSpectrum)
+        return;
+
+    Path path;
+    for (int band = 0; band < VisualisationFeed::numBands; ++band) {
+        const float x = bounds.getX() + bounds.getWidth() * (band + 0.5f) / VisualisationFeed::numBands;
+        const float y = jmap (spectrum.levels[band], VisualisationFeed::minLevel, 0.0f, bounds.getBottom(), bounds.getY());
+
+        if (band == 0)
+            path.startNewSubPath (x, y);
+        else
+            path.lineTo (x, y);
+    }
+
+    g.setColour (Colours::lightblue);
+    g.strokePath (path, PathStrokeType (1.5f));
+}
+
+//tracked voice against the played note, oldest block on the left
+void PitchShiftAudioProcessorEditor::paintPitchTrace (Graphics& g, Rectangle<float> bounds)
+{
+    auto noteToY = [&](float note) {
+        return jmap (jlimit ((float)traceLowestNote, (float)traceHighestNote, note),
+                     (float)traceLowestNote, (float)traceHighestNote, bounds.getBottom(), bounds.getY());
+    };
+
+    //octave lines at every C
+    g.setColour (Colours::darkgrey);
+    for (int note = traceLowestNote; note <= traceHighestNote; note += 12)
+        g.drawHorizontalLine ((int)noteToY ((float)note), bounds.getX(), bounds.getRight());
+
+    Path voicePath, targetPath;
+    bool voiceStarted = false, targetStarted = false;
+    const int oldest = traceWritePosition - traceSize + (traceWritePosition < traceSize ? traceLength : 0);
+
+    for (int index = 0; index < traceSize; ++index) {
+        const VisualisationFeed::TrackPoint& point = trace[(oldest + index) % traceLength];
+        const float x = bounds.getX() + bounds.getWidth() * (float)(traceLength - traceSize + index) / traceLength;
+
+        //gaps where nothing was tracked or no note was held
+        if (point.frequency > 0.0f) {
+            const float y = noteToY (69.0f + 12.0f * std::log2 (point.frequency / 440.0f));
+            voiceStarted ? voicePath.lineTo (x, y) : voicePath.startNewSubPath (x, y);
+            voiceStarted = true;
+        }
+        else {
+            voiceStarted = false;
+        }
+
+        if (point.midiPlayed >= 0) {
+            const float y = noteToY ((float)point.midiPlayed);
+            targetStarted ? targetPath.lineTo (x, y) : targetPath.startNewSubPath (x, y);
+            targetStarted = true;
+        }
+        else {
+            targetStarted = false;
+        }
+    }
+
+    g.setColour (Colours::orange);
+    g.strokePath (targetPath, PathStrokeType (2.0f));
+    g.setColour (Colours::white);
+    g.strokePath (voicePath, PathStrokeType (1.0f));
+
+    if (traceSize > 0) {
+        const VisualisationFeed::TrackPoint& latest = trace[(traceWritePosition + traceLength - 1) % traceLength];
+        String text = latest.passThrough ? String ("pass-through")
+                                         : "voice " + String (latest.midiVoice) + "  target " + String (latest.midiPlayed)
+                                           + "  ratio " + String (latest.ratio, 3);
+        if (pitchLagMs > 0)
+            text += "  pitch lag " + String (pitchLagMs) + " ms";
+        g.drawText (text, bounds.reduced (4.0f), Justification::topLeft);
+    }
+}
+
+void PitchShiftAudioProcessorEditor::timerCallback()
+{
+    bool changed = processor.visualisationFeed.popLatestSpectrum (spectrum);
+    hasSpectrum = hasSpectrum || changed;
+
+    processor.visualisationFeed.popTrackPoints ([this, &changed](const VisualisationFeed::TrackPoint& point) {
+        trace[traceWritePosition] = point;
+        traceWritePosition = (traceWritePosition + 1) % traceLength;
+        traceSize = jmin (traceSize + 1, (int)traceLength);
+        changed = true;
+    });
+
+    const int newPitchLagMs = roundToInt (processor.getPitchLagMs());
+    changed = changed || newPitchLagMs != pitchLagMs;
+    pitchLagMs = newPitchLagMs;
+
+    if (changed)
+        repaint (displayBounds);
 }
 
 void PitchShiftAudioProcessorEditor::resized()
@@ -108,6 +222,8 @@ void PitchShiftAudioProcessorEditor::resized()
 
         r = r.removeFromBottom (r.getHeight() - editorPadding);
     }
+
+    displayBounds = getLocalBounds().reduced (editorMargin).removeFromBottom (displayHeight);
 }
 
 //==============================================================================
@@ -3,7 +3,8 @@
 #include "../JuceLibraryCode/JuceHeader.h"
 #include "PluginProcessor.h"
 
-class PitchShiftAudioProcessorEditor : public AudioProcessorEditor
+class PitchShiftAudioProcessorEditor : public AudioProcessorEditor,
+                                      private Timer
 {
 public:
 
@@ -14,6 +15,9 @@ public:
     void resized() override;
 
 private:
+    void timerCallback() override;
+    void paintSpectrum (Graphics& g, Rectangle<float> bounds);
+    void paintPitchTrace (Graphics& g, Rectangle<float> bounds);
 
     HarmonizerAudioProcessor& processor;
 
@@ -28,6 +32,13 @@ private:
         buttonHeight = 25,
         comboBoxHeight = 25,
         labelWidth = 100,
+
+        displayHeight = 240,
+        displayRefreshRate = 30,
+        //blocks of pitch trace on screen
+        traceLength = 400,
+        traceLowestNote = 36,
+        traceHighestNote = 84,
     };
 
     //======================================
@@ -47,6 +58,18 @@ private:
     OwnedArray<ButtonAttachment> buttonAttachments;
     OwnedArray<ComboBoxAttachment> comboBoxAttachments;
 
+    //======================================
+    //spectrum and pitch trace drained from the processor's feed
+
+    Rectangle<int> displayBounds;
+    VisualisationFeed::Spectrum spectrum;
+    bool hasSpectrum = false;
+    VisualisationFeed::TrackPoint trace[traceLength];
+    int traceWritePosition = 0;
+    int traceSize = 0;
+    //of the async pitch tracker, shown with the latest trace point
+    int pitchLagMs = 0;
+
     //==============================================================================
 
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (PitchShiftAudioProcessorEditor)
@@ -181,7 +181,8 @@ public:
                              const String& paramName,
                              const StringArray items,
                              const int defaultChoice = 0,
-                             const std::function<float (const float)> callback = nullptr)
+                             const std::function<float (const float)> callback = nullptr,
+                             const bool automatable = true)
         : PluginParameter (parametersManager, callback)
         , paramName (paramName)
         , items (items)
@@ -196,7 +197,8 @@ public:
         parametersManager.apvts.createAndAddParameter (std::make_unique<Parameter>
             (paramID, paramName, "", range, (float)defaultChoice,
              [items](float value){ return items[(int)value]; },
-             [items](const String& text){ return items.indexOf (text); })
+             [items](const String& text){ return items.indexOf (text); },
+             false, automatable, true)
         );
 
         parametersManager.apvts.addParameterListener (paramID, this);
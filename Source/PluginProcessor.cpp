@@ -11,6 +11,7 @@ HarmonizerAudioProcessor::HarmonizerAudioProcessor():
                     #if ! JucePlugin_IsMidiEffect
                      #if ! JucePlugin_IsSynth
                       .withInput  ("Input",  AudioChannelSet::stereo(), true)
+                      .withInput  ("Sidechain", AudioChannelSet::mono(), false)
                      #endif
                       .withOutput ("Output", AudioChannelSet::stereo(), true)
                     #endif
@@ -26,10 +27,7 @@ HarmonizerAudioProcessor::HarmonizerAudioProcessor():
                         const ScopedLock sl (lock);
                         value = (float)(1 << ((int)value + 5));
                         paramFftSize.setCurrentAndTargetValue (value);
-                        updateFftSize();
-                        updateHopSize();
-                        updateAnalysisWindow();
-                        updateWindowScaleFactor();
+                        updateEngine();
                         return value;
                     })
     , paramHopSize (parameters, "Hop size", hopSizeItemsUI, hopSize8,
@@ -37,24 +35,86 @@ HarmonizerAudioProcessor::HarmonizerAudioProcessor():
                         const ScopedLock sl (lock);
                         value = (float)(1 << ((int)value + 1));
                         paramHopSize.setCurrentAndTargetValue (value);
-                        updateFftSize();
-                        updateHopSize();
-                        updateAnalysisWindow();
-                        updateWindowScaleFactor();
+                        updateEngine();
                         return value;
                     })
     , paramWindowType (parameters, "Window type", windowTypeItemsUI, windowTypeHann,
                        [this](float value){
                            const ScopedLock sl (lock);
                            paramWindowType.setCurrentAndTargetValue (value);
-                           updateFftSize();
-                           updateHopSize();
-                           updateAnalysisWindow();
-                           updateWindowScaleFactor();
+                           updateEngine();
                            return value;
                        })
+    , paramFormants (parameters, "Preserve formants", false,
+                     [this](float value) {return value; })
+    , paramChannelAnalysis (parameters, "Channel analysis", channelAnalysisItemsUI, channelAnalysisPerChannel,
+                            [this](float value){
+                                const ScopedLock sl (lock);
+                                paramChannelAnalysis.setCurrentAndTargetValue (value);
+                                updateEngine();
+                                return value;
+                            })
+    , paramParallelChannels (parameters, "Parallel channels", false,
+                             [this](float value){
+                                 const ScopedLock sl (lock);
+                                 paramParallelChannels.setCurrentAndTargetValue (value);
+                                 updateEngine();
+                                 return value;
+                             })
+    , paramGateThreshold (parameters, "Gate threshold", " dB", -120.0f, -20.0f, -90.0f,
+                          [this](float value) {return value; })
+    , paramGateHold (parameters, "Gate hold", " ms", 0.0f, 500.0f, 100.0f,
+                     [this](float value) {return value; })
+    , paramAutoFftSize (parameters, "Auto FFT size", false,
+                        [this](float value){
+                            const ScopedLock sl (lock);
+                            paramAutoFftSize.setCurrentAndTargetValue (value);
+                            updateEngine();
+                            return value;
+                        })
+    , paramWindowLength (parameters, "Window length", " ms", 1.0f, 180.0f, 11.6f,
+                         [this](float value){
+                             const ScopedLock sl (lock);
+                             paramWindowLength.setCurrentAndTargetValue (value);
+                             if (paramAutoFftSize.getTargetValue() != 0.0f) {
+                                 updateEngine();
+                             }
+                             return value;
+                         })
+    , paramAsyncPitch (parameters, "Async pitch", false,
+                       [this](float value) {return value; })
+    , paramPitchLag (parameters, "Pitch lag", " ms", 1.0f, (float)PitchAnalysisThread::maxLag, 20.0f,
+                     [this](float value) {return value; })
+    , paramPitchTracker (parameters, "Pitch tracker", pitchTrackerItemsUI, pitchTrackerYin,
+                         [this](float value) {return value; })
+    , paramPitchSource (parameters, "Pitch source", pitchSourceItemsUI, pitchSourceInput,
+                        [this](float value) {return value; })
+    , paramPitchSend (parameters, "Pitch send", pitchSendItemsUI, 0,
+                      [this](float value) {return value; })
+    , paramNoteConfidence (parameters, "Note confidence", "", 0.0f, 1.0f, 0.5f,
+                           [this](float value) {return value; })
+    , paramNoteHysteresis (parameters, "Note hysteresis", " Semitone(s)", 0.0f, 0.5f, 0.25f,
+                           [this](float value) {return value; })
+    , paramMinNoteLength (parameters, "Min note length", " ms", 0.0f, 200.0f, 50.0f,
+                          [this](float value) {return value; })
+    , paramGovernor (parameters, "CPU governor", false,
+                     [this](float value) {return value; })
+    , paramCpuBudget (parameters, "CPU budget", " %", 1.0f, 100.0f, 25.0f,
+                      [this](float value) {return value; })
+    , paramQuality (parameters, "Quality", qualityItemsUI, QualityGovernor::levelFull,
+                    [this](float value) {return value; }, false)
+    , paramAnalysisCache (parameters, "Analysis cache", analysisCacheItemsUI, analysisCacheOff,
+                          [this](float value) {return value; })
 {
     parameters.apvts.state = ValueTree (Identifier (getName().removeCharacters ("- ")));
+    parameters.apvts.state.setProperty (instanceIDProperty, instanceID, nullptr);
+
+    createPitchDetectors (pitchDetectors);
+    createPitchDetectors (pitchAnalysis.detectors);
+
+    governor.onLevelChange = [this](int level) { applyQualityLevel (level); };
+
+    engine.setFFTFactory (createFFT);
 }
 
 HarmonizerAudioProcessor::~HarmonizerAudioProcessor()
@@ -73,61 +133,164 @@ void HarmonizerAudioProcessor::prepareToPlay (double sampleRate, int samplesPerB
     paramHopSize.reset (sampleRate, smoothTime);
     paramWindowType.reset (sampleRate, smoothTime);
 
-    needToResetPhases = true;
+    governor.prepare (sampleRate);
+
+    //only builds with HARMONIZER_AUTOTUNE time their kernels here, the others use the defaults until tuned from the console
+    KernelWisdom::getInstance().tuneInBackground();
+
+    //a worker for every channel but the audio thread's, started outside the lock since that can block. the
+    //parallel channels param only changes how many of them a block wakes, see updateChannelPool
+    channelPool.setNumWorkers (jmax (0, jmin (getMainBusNumInputChannels(), SystemStats::getNumPhysicalCpus()) - 1));
+
+    //the auto fft size depends on the sample rate and the rings on the block size
+    {
+        const ScopedLock sl (lock);
+        preparedBlockSize = samplesPerBlock;
+        visualisationFeed.setSampleRate (sampleRate);
+        sidechainMono.setSize (1, samplesPerBlock);
+        inputDownmix.setSize (1, samplesPerBlock);
+
+        //the first prepare builds the engine from what construction and the restored state recorded
+        deferEngineUpdates = false;
+        updateEngine();
+        engine.reset();
+    }
+
     needToUpdateThreshold = true;
+
+    //the next offline render opens its cache again
+    analysisCache.close();
+    analysisCacheMode = analysisCacheOff;
     
-    //yin setup
-    yin.yinPrepare(sampleRate, samplesPerBlock);
+    //pitch tracker setup
+    for (auto* detector : pitchDetectors)
+        detector->prepare (sampleRate, samplesPerBlock);
+    pitchAnalysis.prepare (sampleRate, samplesPerBlock);
 }
 
 void HarmonizerAudioProcessor::releaseResources()
 {
+    pitchAnalysis.release();
+
+    {
+        const ScopedLock sl (lock);
+        analysisCache.close();
+        analysisCacheMode = analysisCacheOff;
+    }
+
+    //not playing, so no block is running on the workers
+    channelPool.setNumWorkers (0);
 }
 
-void HarmonizerAudioProcessor::processBlock (AudioSampleBuffer& buffer, MidiBuffer& midiMessages)
+void HarmonizerAudioProcessor::updateTrackProperties (const TrackProperties& properties)
 {
     const ScopedLock sl (lock);
+    trackName = properties.name;
+}
 
-    ScopedNoDenormals noDenormals;
+void HarmonizerAudioProcessor::processBlock (AudioSampleBuffer& buffer, MidiBuffer& midiMessages)
+{
+    //a param rebuilding the engine holds the lock, waiting for it is the worst case of automation
+    const int64 lockTicks = Time::getHighResolutionTicks();
+    const ScopedLock sl (lock);
+    lastLockWaitTicks = Time::getHighResolutionTicks() - lockTicks;
+    if (!enginePrepared)
+        return;
 
-    //midiProcessor.processMidi(midiMessages);
+    const int64 startTicks = Time::getHighResolutionTicks();
 
+    ScopedNoDenormals noDenormals;
 
     //initializations
-    const int numInputChannels = getTotalNumInputChannels();
+    const int numInputChannels = getMainBusNumInputChannels();
     const int numOutputChannels = getTotalNumOutputChannels();
     const int numSamples = buffer.getNumSamples();
-    const int sampleRate = getSampleRate();
-
-    //initial buffer write and read positions for FFTs
-    int currentInputBufferWritePosition;
-    int currentOutputBufferWritePosition;
-    int currentOutputBufferReadPosition;
-    int currentSamplesSinceLastFFT;
-
-    //YIN f_0 tracking
-    float frequency = yin.yinPitch(buffer.getReadPointer(0),sampleRate);
-    int midiVoice = yin.yinMidi(frequency);
+    const int64 blockStartSample = getBlockStartSample (numSamples);
+
+    engine.setGate (paramGateThreshold.getTargetValue(), paramGateHold.getTargetValue());
+    engine.setFormantPreservation (paramFormants.getTargetValue() != 0.0f);
+    engine.setNoteTracking (paramNoteConfidence.getTargetValue(), paramNoteHysteresis.getTargetValue(),
+                            paramMinNoteLength.getTargetValue());
+
+    //the pitch is tracked on the input, on the sidechain (the input until one is connected) or
+    //received from another instance's pitch bus, in which case nothing is tracked here
+    const int pitchSource = (int)paramPitchSource.getTargetValue();
+    const float* sidechain = pitchSource == pitchSourceSidechain ? getSidechainInput (buffer) : nullptr;
+    const bool receivePitch = pitchSource >= pitchSourceBus1;
+
+    //in async mode the worker tracks in the background and the audio thread only hands over samples.
+    //the spectral tracker is fed by the stft, so it always runs on the audio thread
+    int pitchTracker = (int)paramPitchTracker.getTargetValue();
+    //under cpu pressure the governor swaps in the cheapest sample based tracker
+    if (governor.getLevel() >= QualityGovernor::levelCheapTracker && pitchTracker != pitchTrackerSpectral)
+        pitchTracker = pitchTrackerAmdf;
+    //the stft only analyses the processed input, a sidechain needs a sample based tracker
+    if (sidechain != nullptr && pitchTracker == pitchTrackerSpectral)
+        pitchTracker = pitchTrackerYin;
+    PitchDetector* detector = pitchDetectors[pitchTracker];
+    const bool asyncPitch = paramAsyncPitch.getTargetValue() != 0.0f && !detector->usesAnalysisFrames() && !receivePitch;
+    engine.setPitchDetector (receivePitch ? nullptr : detector);
+
+    //offline renders can record their analysis, or replay a recorded one instead of analysing again
+    updateAnalysisCache (numSamples);
+    analysisCache.fingerprintInput (buffer.getArrayOfReadPointers(), numInputChannels, numSamples);
+    //a replay of other audio than was recorded is dropped from the first hop that differs, and analysed live
+    if (analysisCache.isReplaying() && analysisCache.hasMismatch())
+        analysisCache.close();
+    const bool cacheOpen = analysisCache.isRecording() || analysisCache.isReplaying();
+    engine.setAnalysisStore (cacheOpen ? &analysisCache : nullptr);
+    //a block that runs frames replays the estimate recorded with the first of them, one that runs none holds
+    //the last frame's. nothing recorded before the first frame
+    PitchEstimate replayedEstimate { 0.0f, 0.0f };
+    const int64 replayedFrame = engine.getFrameIndex() - (engine.getNumFramesDue (numSamples) > 0 ? 0 : 1);
+    const bool replayingPitch = analysisCache.isReplaying()
+                                && (replayedFrame < 0 || analysisCache.readFrame (replayedFrame, 0, nullptr, nullptr, &replayedEstimate));
+
+    //a tracker taking over here (a param change, the governor's cheap one) or live analysis resuming after a
+    //replay, the bus or the worker still holds the history of when it last ran, it starts again. so does the worker's
+    const bool syncPitch = !replayingPitch && !receivePitch && !asyncPitch;
+    if (syncPitch && pitchTracker != syncPitchTracker)
+        detector->prepare (getSampleRate(), preparedBlockSize);
+    syncPitchTracker = syncPitch ? pitchTracker : -1;
+
+    const bool asyncPitchFed = !replayingPitch && !receivePitch && asyncPitch;
+    if (asyncPitchFed && !asyncPitchFedLastBlock)
+        pitchAnalysis.restart();
+    asyncPitchFedLastBlock = asyncPitchFed;
 
     //Midi
     midi.processMidi(midiMessages, numSamples);
-    float targetFrequency = midi.frequency;
-    int midiPlayed = midi.midiNumber;
-    //DBG("targetFrequency: "<<targetFrequency<<"| tracked frequency: "<<frequency);
- 
-    //calculate shift using pitch fore finer grain control (suffers from the pitch tracker's volatility and still requires quantization)
-    //float shiftCurrent = targetFrequency / frequency;
-
-    //calc shift using midi for a quick and dirty quantization to the 12 tone western scale
-    float delta = midiPlayed - midiVoice;
-    float shiftCurrent = pow(2.0f, (delta) / 12.0f);
+    engine.setPlayedNote (midi.midiNumber);
 
-    //very primitive safeguard for shifting
-    if (abs(shiftCurrent - shift) < 12) shift = shiftCurrent;
+    //nothing is drawn while the editor is closed
+    const bool feedVisualisation = visualisationFeed.isActive();
+    engine.setFrameObserver (feedVisualisation ? &visualisationFeed : nullptr);
 
-    //shift using ui (ui element is all commented out)
-    //feature to enable --> choose from fixed interval pitch shift (default) or automatic (with pitch track and midi))
-    //float shift = paramShift.getNextValue();
+    //the recording has the estimate, nothing to track
+    const float* const* inputs = buffer.getArrayOfReadPointers();
+    float* const* outputs = buffer.getArrayOfWritePointers();
+    if (replayingPitch) {
+        engine.process (inputs, outputs, numSamples, replayedEstimate);
+    }
+    else if (receivePitch) {
+        //no sender (yet) means no pitch, which passes the input through
+        PitchEstimate receivedEstimate { 0.0f, 0.0f };
+        PitchBus::get (pitchSource - pitchSourceBus1).receive (blockStartSample, receivedEstimate);
+        engine.process (inputs, outputs, numSamples, receivedEstimate);
+    }
+    else if (asyncPitch) {
+        pitchAnalysis.setLag (paramPitchLag.getTargetValue());
+        pitchAnalysis.setDetector (pitchTracker);
+        pitchAnalysis.pushSamples (sidechain != nullptr ? sidechain : getAnalysisInput (buffer), numSamples);
+        engine.process (inputs, outputs, numSamples, pitchAnalysis.getLatestResult());
+    }
+    else if (sidechain != nullptr) {
+        detector->pushSamples (sidechain, numSamples);
+        engine.process (inputs, outputs, numSamples, detector->getPitch());
+    }
+    else {
+        engine.process (inputs, outputs, numSamples);
+    }
 
     //Handle threshold paramter smoothing
     float newThreshold = paramThreshold.getNextValue();
@@ -135,263 +298,336 @@ void HarmonizerAudioProcessor::processBlock (AudioSampleBuffer& buffer, MidiBuff
         needToUpdateThreshold = true;
     if (newThreshold == paramThreshold.getTargetValue() && needToUpdateThreshold)
     {
-        yin.yinUpdateThreshold(newThreshold);
+        for (auto* detector : pitchDetectors)
+            detector->setThreshold (newThreshold);
+        pitchAnalysis.setThreshold (newThreshold);
         needToUpdateThreshold = false;
     }
 
-    if (midiPlayedCurrent != midiPlayed || midiVoiceCurrent != midiVoice)
+    const HarmonizerEngine::TrackingState& tracking = engine.getTrackingState();
+    if (feedVisualisation)
+        visualisationFeed.pushTrackingState (tracking);
+
+    //what was tracked here, or received from another bus, goes out to the instances receiving it
+    if (const int pitchSend = (int)paramPitchSend.getTargetValue())
+        PitchBus::get (pitchSend - 1).send (this, blockStartSample, numSamples, { tracking.frequency, tracking.confidence });
+
+    //sanity clear extra channel data if needed
+    for (int channel = numInputChannels; channel < numOutputChannels; ++channel)
+        buffer.clear (channel, 0, numSamples);
+
+    //offline renders have no deadline
+    governor.setBudget (paramCpuBudget.getTargetValue() * 0.01f);
+    governor.update (startTicks, numSamples, paramGovernor.getTargetValue() != 0.0f && !isNonRealtime());
+}
+
+//every segment gets an engine set up like the live one, tracking the input with the selected tracker.
+//the sidechain, the pitch buses, the async tracker and the analysis cache are for the live engine only
+SegmentRender::Result HarmonizerAudioProcessor::renderSegmented (const AudioSampleBuffer& input, const MidiBuffer& midiMessages,
+                                                                 AudioSampleBuffer& output)
+{
+    HarmonizerEngine::Config config;
+    Array<float> downmixGains;
     {
-        midiPlayedCurrent = midiPlayed;
-        midiVoiceCurrent = midiVoice;
-        needToResetPhases = true;
+        const ScopedLock sl (lock);
+        if (!enginePrepared || input.getNumChannels() < engine.getConfig().numChannels)
+            return {};
+
+        //the segments are what runs side by side
+        config = engine.getConfig();
+        config.parallelChannels = false;
+        if (config.sharedAnalysis)
+            downmixGains = getDownmixGains();
     }
 
-    float ratio = roundf (shift * (float)hopSize) / (float)hopSize;
-    int resampledLength = floorf ((float)fftSize / ratio);
-
-    DBG("midiPlayed: " << midiPlayed << "| midiVoice: " << midiVoice << "| tracked frequency: " << frequency <<"| Shift: " << shift);
-
-    HeapBlock<float> resampledOutput (resampledLength, true);
-    HeapBlock<float> synthesisWindow (resampledLength, true);
-    updateWindow (synthesisWindow, resampledLength);
-
-    //sample processing loop
-    for (int channel = 0; channel < numInputChannels; ++channel) {
-        float* channelData = buffer.getWritePointer (channel);
-
-        //init current buffer positions
-        currentInputBufferWritePosition = inputBufferWritePosition;
-        currentOutputBufferWritePosition = outputBufferWritePosition;
-        currentOutputBufferReadPosition = outputBufferReadPosition;
-        currentSamplesSinceLastFFT = samplesSinceLastFFT;
-
-        for (int sample = 0; sample < numSamples; ++sample) {
-            //get input
-            const float in = channelData[sample];
-            //store output
-            channelData[sample] = outputBuffer.getSample (channel, currentOutputBufferReadPosition);
-
-            //synthesis stage
-            // 
-            //zero the output and store the input in buffer. reset read positions if needed
-            outputBuffer.setSample (channel, currentOutputBufferReadPosition, 0.0f);
-            if (++currentOutputBufferReadPosition >= outputBufferLength)
-                currentOutputBufferReadPosition = 0;
-
-            inputBuffer.setSample (channel, currentInputBufferWritePosition, in);
-            if (++currentInputBufferWritePosition >= inputBufferLength)
-                currentInputBufferWritePosition = 0;
-
-            //check if enough samples have come in according to hopsize
-            if (++currentSamplesSinceLastFFT >= hopSize) {
-                currentSamplesSinceLastFFT = 0;
-
-                //apply window on input and store in fft time domain buffer (imag is 0.0 since real signal)
-                int inputBufferIndex = currentInputBufferWritePosition;
-                for (int index = 0; index < fftSize; ++index) {
-                    fftTimeDomain[index].real (sqrtf (fftWindow[index]) * inputBuffer.getSample (channel, inputBufferIndex));
-                    fftTimeDomain[index].imag (0.0f);
-
-                    if (++inputBufferIndex >= inputBufferLength)
-                        inputBufferIndex = 0;
-                }
-            
-                //perform fft on the time domain buffer and store in freq domain buffer
-                fft->perform (fftTimeDomain, fftFrequencyDomain, false);
-
-                //phase reset when changing the parameter due to smoothing
-                //if (paramShift.isSmoothing())
-                //    needToResetPhases = true;
-                //if (shift == paramShift.getTargetValue() && needToResetPhases) {
-                //    inputPhase.clear();
-                //    outputPhase.clear();
-                //    needToResetPhases = false;
-                //}
-
-                if (needToResetPhases)
-                {
-                    inputPhase.clear();
-                    outputPhase.clear();
-                    needToResetPhases = false;
-                }
-
-                //modification stage
-                // 
-                //modify stft and apply effect
-                for (int index = 0; index < fftSize; ++index) {
-
-                    //initialize magnitude and phase
-                    float magnitude = abs (fftFrequencyDomain[index]);
-                    float phase = arg (fftFrequencyDomain[index]);
-
-                    //calculate needed phase shift according to deltaPhi and ratio
-                    float phaseDeviation = phase - inputPhase.getSample (channel, index) - omega[index] * (float)hopSize;
-                    float deltaPhi = omega[index] * hopSize + princArg (phaseDeviation);
-                    float newPhase = princArg (outputPhase.getSample (channel, index) + deltaPhi * ratio);
-
-                    //store phases in buffers to keep track of phase
-                    inputPhase.setSample (channel, index, phase);
-                    outputPhase.setSample (channel, index, newPhase);
-                    
-                    //store
-                    fftFrequencyDomain[index] = std::polar (magnitude, newPhase);
-                }
-
-                //synthesis stage
-                //
-                //inverse fft from freq domain buffer to time domain buffer
-                fft->perform (fftFrequencyDomain, fftTimeDomain, true);
-
-                for (int index = 0; index < resampledLength; ++index) {
-                    //reconstruct signal
-                    float x = (float)index * (float)fftSize / (float)resampledLength;
-                    int ix = (int)floorf (x);
-                    float dx = x - (float)ix;
-
-                    float sample1 = fftTimeDomain[ix].real();
-                    float sample2 = fftTimeDomain[(ix + 1) % fftSize].real();
-                    resampledOutput[index] = sample1 + dx * (sample2 - sample1);
-                    resampledOutput[index] *= sqrtf (synthesisWindow[index]);
-                }
-
-                //store resampled ouput signal in system output buffer and scale according to ratio
-                int outputBufferIndex = currentOutputBufferWritePosition;
-                for (int index = 0; index < resampledLength; ++index) {
-                    float out = outputBuffer.getSample (channel, outputBufferIndex);
-                    out += resampledOutput[index] * windowScaleFactor;
-                    outputBuffer.setSample (channel, outputBufferIndex, out);
-
-                    if (++outputBufferIndex >= outputBufferLength)
-                        outputBufferIndex = 0;
-                }
-
-                //move write buffer by hop increments
-                currentOutputBufferWritePosition += hopSize;
-                if (currentOutputBufferWritePosition >= outputBufferLength)
-                    currentOutputBufferWritePosition = 0;
-            }
+    const float gateThreshold = paramGateThreshold.getTargetValue();
+    const float gateHold = paramGateHold.getTargetValue();
+    const bool preserveFormants = paramFormants.getTargetValue() != 0.0f;
+    const float noteConfidence = paramNoteConfidence.getTargetValue();
+    const float noteHysteresis = paramNoteHysteresis.getTargetValue();
+    const float minNoteLength = paramMinNoteLength.getTargetValue();
+    const int pitchTracker = (int)paramPitchTracker.getTargetValue();
+    const float threshold = paramThreshold.getTargetValue();
+
+    auto setup = [=](HarmonizerEngine& segmentEngine) {
+        segmentEngine.setGate (gateThreshold, gateHold);
+        segmentEngine.setFormantPreservation (preserveFormants);
+        segmentEngine.setNoteTracking (noteConfidence, noteHysteresis, minNoteLength);
+        if (config.sharedAnalysis)
+            segmentEngine.setDownmix (downmixGains.begin());
+
+        OwnedArray<PitchDetector> detectors;
+        createPitchDetectors (detectors);
+        std::unique_ptr<PitchDetector> detector (detectors.removeAndReturn (pitchTracker));
+        detector->prepare (config.sampleRate, config.maxBlockSize);
+        detector->setThreshold (threshold);
+        return detector;
+    };
+
+    //the note every block plays, read block by block like processBlock does
+    const int numSamples = input.getNumSamples();
+    std::vector<SegmentRender::NoteEvent> notes;
+    MidiProcessor renderMidi;
+    int playedNote = renderMidi.midiNumber;
+    for (int start = 0; start < numSamples; start += config.maxBlockSize) {
+        const int length = jmin (config.maxBlockSize, numSamples - start);
+        MidiBuffer blockMidi;
+        blockMidi.addEvents (midiMessages, start, length, -start);
+        renderMidi.processMidi (blockMidi, length);
+
+        if (renderMidi.midiNumber != playedNote) {
+            playedNote = renderMidi.midiNumber;
+            notes.push_back ({ start, playedNote });
         }
     }
 
-    //set buffer position values
-    inputBufferWritePosition = currentInputBufferWritePosition;
-    outputBufferWritePosition = currentOutputBufferWritePosition;
-    outputBufferReadPosition = currentOutputBufferReadPosition;
-    samplesSinceLastFFT = currentSamplesSinceLastFFT;
-
-    //sanity clear extra channel data if needed
-    for (int channel = numInputChannels; channel < numOutputChannels; ++channel)
-        buffer.clear (channel, 0, numSamples);
+    output.setSize (config.numChannels, numSamples, false, false, true);
+    return SegmentRender::render (config, input.getArrayOfReadPointers(), output.getArrayOfWritePointers(), numSamples,
+                                  notes, setup, createFFT);
 }
 
 //==============================================================================
 
 
-//update fft size depending on params
-void HarmonizerAudioProcessor::updateFftSize()
+//the sidechain bus as one channel, null while it is disabled or empty. stereo is summed into a buffer sized in prepareToPlay
+const float* HarmonizerAudioProcessor::getSidechainInput (AudioSampleBuffer& buffer)
 {
-    //get fft size from params
-    fftSize = (int)paramFftSize.getTargetValue();
-    //init fft instance
-    fft = std::make_unique<dsp::FFT>(log2 (fftSize));
+    if (getBusCount (true) < 2 || !getBus (true, 1)->isEnabled())
+        return nullptr;
+
+    AudioSampleBuffer sidechainBuffer = getBusBuffer (buffer, true, 1);
+    const int numChannels = sidechainBuffer.getNumChannels();
+    const int numSamples = sidechainBuffer.getNumSamples();
+    if (numChannels == 0)
+        return nullptr;
+    if (numChannels == 1 || numSamples > sidechainMono.getNumSamples())
+        return sidechainBuffer.getReadPointer (0);
+
+    sidechainMono.copyFrom (0, 0, sidechainBuffer, 0, 0, numSamples);
+    for (int channel = 1; channel < numChannels; ++channel)
+        sidechainMono.addFrom (0, 0, sidechainBuffer, channel, 0, numSamples);
+    sidechainMono.applyGain (0, 0, numSamples, 1.0f / (float)numChannels);
+    return sidechainMono.getReadPointer (0);
+}
 
-    //init the buffer and its params and update size
-    inputBufferLength = fftSize;
-    inputBufferWritePosition = 0;
-    inputBuffer.clear();
-    inputBuffer.setSize (getTotalNumInputChannels(), inputBufferLength);
+//what the engine tracks on its own: channel 0, or the shared analysis downmix in a buffer sized in prepareToPlay
+const float* HarmonizerAudioProcessor::getAnalysisInput (AudioSampleBuffer& buffer)
+{
+    const int numSamples = buffer.getNumSamples();
+    if (!engine.getConfig().sharedAnalysis || numSamples > inputDownmix.getNumSamples())
+        return buffer.getReadPointer (0);
 
-    //Same for output buffer and its params
-    float maxRatio = powf (2.0f, -12.0f / 12.0f);
-    outputBufferLength = (int)floorf ((float)fftSize / maxRatio);
-    outputBufferWritePosition = 0;
-    outputBufferReadPosition = 0;
-    outputBuffer.clear();
-    outputBuffer.setSize (getTotalNumInputChannels(), outputBufferLength);
+    engine.downmix (buffer.getArrayOfReadPointers(), 0, numSamples, inputDownmix.getWritePointer (0));
+    return inputDownmix.getReadPointer (0);
+}
 
-    //reallocate values for the windows and analysis and synthesis buffers (since from heap then you need to use realloc)
-    fftWindow.realloc (fftSize);
-    fftWindow.clear (fftSize);
+//the host's position, so instances sharing a pitch bus agree on which block is which. without a transport
+//every instance counts on its own and receivers use the newest result
+int64 HarmonizerAudioProcessor::getBlockStartSample (const int numSamples)
+{
+    int64 startSample = freeRunningPosition;
+    if (AudioPlayHead* playHead = getPlayHead())
+        if (const auto position = playHead->getPosition())
+            if (const auto timeInSamples = position->getTimeInSamples())
+                startSample = *timeInSamples;
+
+    freeRunningPosition = startSample + numSamples;
+    return startSample;
+}
 
-    fftTimeDomain.realloc (fftSize);
-    fftTimeDomain.clear (fftSize);
+//one of each tracker, in pitchTrackerIndex order
+void HarmonizerAudioProcessor::createPitchDetectors (OwnedArray<PitchDetector>& detectors)
+{
+    detectors.add (new YinPitchDetector());
+    detectors.add (new McLeodPitchDetector());
+    detectors.add (new AmdfPitchDetector());
+    detectors.add (new SpectralPitchDetector());
+}
 
-    fftFrequencyDomain.realloc (fftSize);
-    fftFrequencyDomain.clear (fftSize);
+//the engine only knows the vendored fft, the juce one is faster where it has ipp or vdsp.
+//which one wins at which size is measured once per machine, see KernelWisdom
+std::unique_ptr<FFTEngine> HarmonizerAudioProcessor::createFFT (int order, std::shared_ptr<const StockhamFFT::Twiddles> twiddles)
+{
+    return FFTEngine::create (order, KernelWisdom::getInstance().getBackend (1 << order), std::move (twiddles));
+}
 
-    //reset samples since last fft
-    samplesSinceLastFFT = 0;
+//nearest power of two (32 to 8192) to the window length in ms
+int HarmonizerAudioProcessor::getAutoFftSize (const double sampleRate)
+{
+    const double windowLength = paramWindowLength.getTargetValue() * 1e-3 * sampleRate;
+    const int order = jlimit (5, 13, roundToInt (log2 (jmax (1.0, windowLength))));
+    return 1 << order;
+}
+
+//the engine config from the params, the sample rate and block size the host prepared and the governor's level
+HarmonizerEngine::Config HarmonizerAudioProcessor::getEngineConfig()
+{
+    HarmonizerEngine::Config config;
+    config.sampleRate = getSampleRate();
+    config.numChannels = getMainBusNumInputChannels();
+    config.maxBlockSize = preparedBlockSize;
+    config.windowType = (int)paramWindowType.getTargetValue();
+
+    //sharing the analysis and spreading the channels over threads only pay off with more than one
+    config.sharedAnalysis = (int)paramChannelAnalysis.getTargetValue() != channelAnalysisPerChannel && config.numChannels > 1;
+    config.parallelChannels = paramParallelChannels.getTargetValue() != 0.0f && config.numChannels > 1;
+
+    //get fft size from params, or from the window length in auto mode once the sample rate is known
+    config.fftSize = (int)paramFftSize.getTargetValue();
+    if (paramAutoFftSize.getTargetValue() != 0.0f && getSampleRate() > 0.0)
+        config.fftSize = getAutoFftSize (getSampleRate());
+
+    //the governor trades overlap for cpu
+    config.overlap = (int)paramHopSize.getTargetValue();
+    const int level = governor.getLevel();
+    if (level >= QualityGovernor::levelMinimal)
+        config.overlap = jmin (config.overlap, 2);
+    else if (level >= QualityGovernor::levelLargerHop)
+        config.overlap = jmax (2, config.overlap / 2);
+
+    config.batchLength = KernelWisdom::getInstance().getBatchLength (config.fftSize, config.overlap);
+
+    return config;
+}
 
+//not realtime safe, reallocates the engine's buffers when its config changed. the downmix and the
+//workers follow the layout and params, which can change without the config
+void HarmonizerAudioProcessor::updateEngine()
+{
+    if (deferEngineUpdates)
+        return;
 
-    omega.realloc (fftSize);
-    for (int index = 0; index < fftSize; ++index) omega[index] = 2.0f * M_PI * index / (float)fftSize;
+    const HarmonizerEngine::Config config = getEngineConfig();
+    if (!enginePrepared || config != engine.getConfig()) {
+        engine.prepare (config);
+        enginePrepared = true;
+    }
 
-    inputPhase.clear();
-    inputPhase.setSize (getTotalNumInputChannels(), outputBufferLength);
+    updateDownmix();
+    updateChannelPool();
+    setLatencySamples (engine.getLatencySamples());
+}
 
-    outputPhase.clear();
-    outputPhase.setSize (getTotalNumInputChannels(), outputBufferLength);
+//the engine's shared analysis downmix follows the layout and the channel analysis param
+void HarmonizerAudioProcessor::updateDownmix()
+{
+    if (engine.getConfig().sharedAnalysis)
+        engine.setDownmix (getDownmixGains().begin());
 }
 
-//update hop size according to params
-void HarmonizerAudioProcessor::updateHopSize()
+//gains of the shared analysis downmix from the main bus layout. layouts without the channel types
+//asked for (discrete channels, no lfe) mix every channel
+Array<float> HarmonizerAudioProcessor::getDownmixGains()
 {
-    overlap = (int)paramHopSize.getTargetValue();
-    if (overlap != 0) {
-        hopSize = fftSize / overlap;
-        outputBufferWritePosition = hopSize % outputBufferLength;
+    const HarmonizerEngine::Config& config = engine.getConfig();
+    const int mode = (int)paramChannelAnalysis.getTargetValue();
+    const AudioChannelSet layout = getChannelLayoutOfBus (true, 0);
+
+    Array<float> gains;
+    gains.insertMultiple (0, 0.0f, config.numChannels);
+    int numMixed = 0;
+    for (int channel = 0; channel < config.numChannels; ++channel) {
+        const AudioChannelSet::ChannelType type = channel < layout.size() ? layout.getTypeOfChannel (channel)
+                                                                          : AudioChannelSet::unknown;
+        bool mixed = true;
+        if (mode == channelAnalysisFirst)
+            mixed = channel == 0;
+        else if (mode == channelAnalysisFront)
+            mixed = type == AudioChannelSet::left || type == AudioChannelSet::right || type == AudioChannelSet::centre;
+        else if (mode == channelAnalysisAllButLfe)
+            mixed = type != AudioChannelSet::LFE && type != AudioChannelSet::LFE2;
+
+        if (mixed) {
+            gains.set (channel, 1.0f);
+            ++numMixed;
+        }
     }
+
+    if (numMixed == 0) {
+        gains.fill (1.0f);
+        numMixed = config.numChannels;
+    }
+
+    for (int channel = 0; channel < config.numChannels; ++channel)
+        gains.set (channel, gains[channel] / (float)numMixed);
+    return gains;
 }
 
-//call update on analysis window
-void HarmonizerAudioProcessor::updateAnalysisWindow()
+//workers for the channels the audio thread does not run itself, while parallel channels are on. the threads
+//were started by prepareToPlay, here they are only picked
+void HarmonizerAudioProcessor::updateChannelPool()
 {
-    updateWindow (fftWindow, fftSize);
+    const HarmonizerEngine::Config& config = engine.getConfig();
+    const int numWorkers = config.parallelChannels ? jmin (config.numChannels, SystemStats::getNumPhysicalCpus()) - 1 : 0;
+    channelPool.setNumActiveWorkers (numWorkers);
+    engine.setChannelExecutor (config.parallelChannels ? &channelPool : nullptr);
 }
 
-//update window according to chosen param
-void HarmonizerAudioProcessor::updateWindow (const HeapBlock<float>& window, const int windowLength)
+//offline renders only, opening, writing and mapping files is not realtime safe.
+//a new mode, layout or a jump on the host's timeline closes the cache and starts a new file or replay
+void HarmonizerAudioProcessor::updateAnalysisCache (const int numSamples)
 {
-    switch ((int)paramWindowType.getTargetValue()) {
-        case windowTypeBartlett: {
-            for (int sample = 0; sample < windowLength; ++sample)
-                window[sample] = 1.0f - fabs (2.0f * (float)sample / (float)(windowLength - 1) - 1.0f);
-            break;
-        }
-        case windowTypeHann: {
-            for (int sample = 0; sample < windowLength; ++sample)
-                window[sample] = 0.5f - 0.5f * cosf (2.0f * M_PI * (float)sample / (float)(windowLength - 1));
-            break;
-        }
-        case windowTypeHamming: {
-            for (int sample = 0; sample < windowLength; ++sample)
-                window[sample] = 0.54f - 0.46f * cosf (2.0f * M_PI * (float)sample / (float)(windowLength - 1));
-            break;
+    const int mode = isNonRealtime() ? (int)paramAnalysisCache.getTargetValue() : (int)analysisCacheOff;
+
+    AnalysisCache::Layout layout;
+    layout.sampleRate = engine.getConfig().sampleRate;
+    layout.fftSize = engine.getConfig().fftSize;
+    layout.hopSize = engine.getHopSize();
+    layout.numChannels = engine.getNumAnalysisChannels();
+    layout.windowType = engine.getConfig().windowType;
+    layout.startSample = analysisCachePosition;
+    layout.hopPhase = engine.getHopPhase();
+
+    bool jumped = false;
+    if (AudioPlayHead* playHead = getPlayHead()) {
+        if (const auto position = playHead->getPosition()) {
+            if (const auto timeInSamples = position->getTimeInSamples()) {
+                jumped = *timeInSamples != analysisCachePosition;
+                layout.startSample = *timeInSamples;
+            }
         }
     }
-}
 
-//updating window scale factor depending on overlap and fftSize
-void HarmonizerAudioProcessor::updateWindowScaleFactor()
-{
-    float windowSum = 0.0f;
-    for (int sample = 0; sample < fftSize; ++sample) windowSum += fftWindow[sample];
+    const bool isOpen = analysisCache.isRecording() || analysisCache.isReplaying();
+    const bool restart = mode != analysisCacheMode
+                      || (mode != analysisCacheOff && jumped)
+                      || (isOpen && !analysisCache.getLayout().hasSameFrames (layout));
+
+    if (restart) {
+        analysisCache.close();
+        analysisCacheMode = mode;
+        engine.resetFrameIndex();
+
+        //a missing or mismatching recording falls back to live analysis until the next restart
+        const File file = AnalysisCache::getFileFor (trackName, instanceID, layout);
+        if (mode == analysisCacheRecord)
+            analysisCache.startRecording (file, layout);
+        else if (mode == analysisCacheReplay)
+            analysisCache.openForReplay (file, layout);
+    }
 
-    windowScaleFactor = 0.0f;
-    if (overlap != 0 && windowSum != 0.0f)
-        windowScaleFactor = 1.0f / (float)overlap / windowSum * (float)fftSize;
+    analysisCachePosition = layout.startSample + numSamples;
 }
 
-//phase wrapping
-float HarmonizerAudioProcessor::princArg (const float phase)
+//message thread: apply a new governor level without reallocating the buffers
+void HarmonizerAudioProcessor::applyQualityLevel (const int level)
 {
-    if (phase >= 0.0f) return fmod (phase + M_PI,  2.0f * M_PI) - M_PI;
-    else return fmod (phase + M_PI, -2.0f * M_PI) + M_PI;
+    {
+        const ScopedLock sl (lock);
+        if (enginePrepared)
+            engine.setOverlap (getEngineConfig().overlap);
+    }
+
+    //shown in the editor and to the host, nothing reads it back
+    if (auto* parameter = parameters.apvts.getParameter (paramQuality.paramID))
+        parameter->setValueNotifyingHost (parameter->convertTo0to1 ((float)level));
 }
 
 void HarmonizerAudioProcessor::getStateInformation (MemoryBlock& destData)
 {
+    //the quality is the governor's reading of this machine, not part of the session
     auto state = parameters.apvts.copyState();
+    state.removeChild (state.getChildWithProperty ("id", paramQuality.paramID), nullptr);
     std::unique_ptr<XmlElement> xml (state.createXml());
     copyXmlToBinary (*xml, destData);
 }
@@ -400,9 +636,32 @@ void HarmonizerAudioProcessor::setStateInformation (const void* data, int sizeIn
 {
     std::unique_ptr<XmlElement> xmlState (getXmlFromBinary (data, sizeInBytes));
 
-    if (xmlState.get() != nullptr)
-        if (xmlState->hasTagName (parameters.apvts.state.getType()))
-            parameters.apvts.replaceState (ValueTree::fromXml (*xmlState));
+    if (xmlState.get() == nullptr || !xmlState->hasTagName (parameters.apvts.state.getType()))
+        return;
+
+    //every restored param would rebuild the engine on its own, it is built once with all of them
+    bool wasDeferred;
+    {
+        const ScopedLock sl (lock);
+        wasDeferred = deferEngineUpdates;
+        deferEngineUpdates = true;
+    }
+
+    //nor is it restored from one saved before it was left out. without its child the param keeps its value
+    ValueTree restoredState = ValueTree::fromXml (*xmlState);
+    restoredState.removeChild (restoredState.getChildWithProperty ("id", paramQuality.paramID), nullptr);
+    parameters.apvts.replaceState (restoredState);
+
+    //sessions saved before the id keep the one this instance made up
+    const String restoredID = parameters.apvts.state.getProperty (instanceIDProperty).toString();
+    if (restoredID.isEmpty())
+        parameters.apvts.state.setProperty (instanceIDProperty, instanceID, nullptr);
+
+    const ScopedLock sl (lock);
+    if (restoredID.isNotEmpty())
+        instanceID = restoredID;
+    deferEngineUpdates = wasDeferred;
+    updateEngine();
 }
 
 AudioProcessorEditor* HarmonizerAudioProcessor::createEditor()
@@ -421,16 +680,21 @@ bool HarmonizerAudioProcessor::isBusesLayoutSupported (const BusesLayout& layout
     ignoreUnused (layouts);
     return true;
   #else
-    // This is the place where you check if the layout is supported.
-    // In this template code we only support mono or stereo.
-    if (layouts.getMainOutputChannelSet() != AudioChannelSet::mono()
-     && layouts.getMainOutputChannelSet() != AudioChannelSet::stereo())
+    //any channel set, see the channel analysis for surround layouts
+    if (layouts.getMainOutputChannelSet().isDisabled())
         return false;
 
     // This checks if the input layout matches the output layout
    #if ! JucePlugin_IsSynth
     if (layouts.getMainOutputChannelSet() != layouts.getMainInputChannelSet())
         return false;
+
+    //the sidechain only feeds the pitch tracker, stereo is summed to mono
+    if (layouts.inputBuses.size() > 1) {
+        const AudioChannelSet sidechain = layouts.getChannelSet (true, 1);
+        if (!sidechain.isDisabled() && sidechain != AudioChannelSet::mono() && sidechain != AudioChannelSet::stereo())
+            return false;
+    }
    #endif
 
     return true;
@@ -3,8 +3,21 @@
 #include <cmath>
 #include "../JuceLibraryCode/JuceHeader.h"
 #include "PluginParameter.h"
+#include "JuceFFTEngine.h"
+#include "HarmonizerEngine.h"
 #include "MidiProcessor.h"
 #include "Yin.h"
+#include "McLeodPitchDetector.h"
+#include "AmdfPitchDetector.h"
+#include "SpectralPitchDetector.h"
+#include "PitchAnalysisThread.h"
+#include "QualityGovernor.h"
+#include "AnalysisCache.h"
+#include "VisualisationFeed.h"
+#include "PitchBus.h"
+#include "ChannelThreadPool.h"
+#include "KernelWisdom.h"
+#include "SegmentRender.h"
 
 class HarmonizerAudioProcessor : public AudioProcessor
 {
@@ -39,6 +52,22 @@ public:
     const String getProgramName (int index) override;
     void changeProgramName (int index, const String& newName) override;
 
+    void updateTrackProperties (const TrackProperties& properties) override;
+
+    //offline, once prepared: renders a whole file with the current params and the midi into output (the input's
+    //length, lined up with it) in segments on every core. see SegmentRender
+    SegmentRender::Result renderSegmented (const AudioSampleBuffer& input, const MidiBuffer& midiMessages,
+                                           AudioSampleBuffer& output);
+
+    //audio thread: how long the latest processBlock waited for the lock params reconfigure under, see AutomationStress
+    int64 getLastLockWaitTicks() const { return lastLockWaitTicks; }
+
+    //any thread: how far the async pitch tracker is behind the audio, 0 once it caught up or while it is not used
+    double getPitchLagMs() const
+    {
+        return getSampleRate() > 0.0 ? 1000.0 * (double)pitchAnalysis.getLagSamples() / getSampleRate() : 0.0;
+    }
+
     //==============================================================================
     /*class Harmonizer : public YIN {};*/
 
@@ -92,49 +121,133 @@ public:
         windowTypeHamming,
     };
 
-    //helper functions
-    void updateFftSize();
-    void updateHopSize();
-    void updateAnalysisWindow();
-    void updateWindow (const HeapBlock<float>& window, const int windowLength);
-    void updateWindowScaleFactor();
+    //where the pitch and phases of a multichannel layout come from. the shared ones track a downmix
+    StringArray channelAnalysisItemsUI = {
+        "Per channel",
+        "Shared, first channel",
+        "Shared, all but LFE",
+        "Shared, front channels",
+    };
 
-    float princArg (const float phase);
+    enum channelAnalysisIndex {
+        channelAnalysisPerChannel = 0,
+        channelAnalysisFirst,
+        channelAnalysisAllButLfe,
+        channelAnalysisFront,
+    };
 
-    //======================================
-    //fft buffers and varibales
-    CriticalSection lock;
+    //from the most accurate and expensive to the cheapest
+    StringArray pitchTrackerItemsUI = {
+        "YIN",
+        "McLeod (MPM)",
+        "AMDF (light)",
+        "Spectral (free)",
+    };
+
+    enum pitchTrackerIndex {
+        pitchTrackerYin = 0,
+        pitchTrackerMcLeod,
+        pitchTrackerAmdf,
+        pitchTrackerSpectral,
+    };
 
-    int fftSize;
-    std::unique_ptr<dsp::FFT> fft;
+    //where the tracked pitch comes from. a bus is another instance's tracking, see PitchBus
+    StringArray pitchSourceItemsUI = {
+        "Input",
+        "Sidechain",
+        "Pitch bus 1",
+        "Pitch bus 2",
+        "Pitch bus 3",
+        "Pitch bus 4",
+    };
+
+    enum pitchSourceIndex {
+        pitchSourceInput = 0,
+        pitchSourceSidechain,
+        pitchSourceBus1,
+    };
 
-    int inputBufferLength;
-    int inputBufferWritePosition;
-    AudioSampleBuffer inputBuffer;
+    //shares this instance's tracking with others, "Off" then one item per bus
+    StringArray pitchSendItemsUI = {
+        "Off",
+        "Pitch bus 1",
+        "Pitch bus 2",
+        "Pitch bus 3",
+        "Pitch bus 4",
+    };
 
-    int outputBufferLength;
-    int outputBufferWritePosition;
-    int outputBufferReadPosition;
-    AudioSampleBuffer outputBuffer;
+    //in QualityGovernor::Level order
+    StringArray qualityItemsUI = {
+        "Full",
+        "Larger hop",
+        "Cheap tracker",
+        "Minimal",
+    };
 
-    HeapBlock<float> fftWindow;
-    HeapBlock<dsp::Complex<float>> fftTimeDomain;
-    HeapBlock<dsp::Complex<float>> fftFrequencyDomain;
+    //only used by offline renders
+    StringArray analysisCacheItemsUI = {
+        "Off",
+        "Record",
+        "Replay",
+    };
 
-    int samplesSinceLastFFT;
+    enum analysisCacheIndex {
+        analysisCacheOff = 0,
+        analysisCacheRecord,
+        analysisCacheReplay,
+    };
 
-    int overlap;
-    int hopSize;
-    float windowScaleFactor;
+    //helper functions
+    static void createPitchDetectors (OwnedArray<PitchDetector>& detectors);
+    static std::unique_ptr<FFTEngine> createFFT (int order, std::shared_ptr<const StockhamFFT::Twiddles> twiddles);
+    int getAutoFftSize (const double sampleRate);
+    void applyQualityLevel (const int level);
+    void updateAnalysisCache (const int numSamples);
+    const float* getSidechainInput (AudioSampleBuffer& buffer);
+    const float* getAnalysisInput (AudioSampleBuffer& buffer);
+    int64 getBlockStartSample (const int numSamples);
+    HarmonizerEngine::Config getEngineConfig();
+    void updateEngine();
+    void updateDownmix();
+    Array<float> getDownmixGains();
+    void updateChannelPool();
 
     //======================================
-    //Phase buffers and variables
-    HeapBlock<float> omega;
-    AudioSampleBuffer inputPhase;
-    AudioSampleBuffer outputPhase;
-    bool needToResetPhases;
+    //the dsp, everything below maps the plugin onto it
+    CriticalSection lock;
+    HarmonizerEngine engine;
+    ChannelThreadPool channelPool;
+    //params set before the host prepares or while a state is restored only change what getEngineConfig returns
+    bool enginePrepared = false;
+    bool deferEngineUpdates = true;
+    int preparedBlockSize = 512;
+    int64 lastLockWaitTicks = 0;
     bool needToUpdateThreshold;
 
+    //======================================
+    //Sidechain summed to mono for the tracker, the input's shared analysis downmix for the async tracker,
+    //and where the block starts for the pitch buses
+    AudioSampleBuffer sidechainMono;
+    AudioSampleBuffer inputDownmix;
+    int64 freeRunningPosition = 0;
+
+    //======================================
+    //CPU governor, its level is read when the engine config is built
+    QualityGovernor governor;
+
+    //======================================
+    //Offline analysis cache, one file per instance. the id is saved with the state, so it survives reloading the session
+    AnalysisCache analysisCache;
+    int analysisCacheMode = analysisCacheOff;
+    int64 analysisCachePosition = 0;
+    String trackName;
+    String instanceID = Uuid().toString();
+    const Identifier instanceIDProperty { "instanceID" };
+
+    //======================================
+    //spectrum and pitch trace for the editor, only fed while it is open
+    VisualisationFeed visualisationFeed;
+
     //======================================
     //Params
     PluginParametersManager parameters;
@@ -144,20 +257,38 @@ public:
     PluginParameterComboBox paramFftSize;
     PluginParameterComboBox paramHopSize;
     PluginParameterComboBox paramWindowType;
+    PluginParameterToggle paramFormants;
+    PluginParameterComboBox paramChannelAnalysis;
+    PluginParameterToggle paramParallelChannels;
+    PluginParameterLinSlider paramGateThreshold;
+    PluginParameterLinSlider paramGateHold;
+    PluginParameterToggle paramAutoFftSize;
+    PluginParameterLinSlider paramWindowLength;
+    PluginParameterToggle paramAsyncPitch;
+    PluginParameterLinSlider paramPitchLag;
+    PluginParameterComboBox paramPitchTracker;
+    PluginParameterComboBox paramPitchSource;
+    PluginParameterComboBox paramPitchSend;
+    PluginParameterLinSlider paramNoteConfidence;
+    PluginParameterLinSlider paramNoteHysteresis;
+    PluginParameterLinSlider paramMinNoteLength;
+    PluginParameterToggle paramGovernor;
+    PluginParameterLinSlider paramCpuBudget;
+    PluginParameterComboBox paramQuality;
+    PluginParameterComboBox paramAnalysisCache;
 
     //======================================
-    YIN yin;
+    //one of each tracker, indexed by pitchTrackerIndex
+    OwnedArray<PitchDetector> pitchDetectors;
+    //the one of them the audio thread tracked with last block, -1 if it tracked with none
+    int syncPitchTracker = -1;
+    //whether the last block fed pitchAnalysis
+    bool asyncPitchFedLastBlock = false;
+    PitchAnalysisThread pitchAnalysis;
     MidiProcessor midi;
     MidiKeyboardState keyboardState;
 
 private:
-    int midiVoiceCurrent = 69;
-    int midiPlayedCurrent = 69;
-    float shift = 0.0f;
-    
-
-
-
     //==============================================================================
 
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (HarmonizerAudioProcessor)
@@ -0,0 +1,147 @@
+/*
+  ==============================================================================
+
+    QualityGovernor.h
+    Author:  Sami S
+
+    Keeps the processor within a share of the block deadline by stepping its
+    quality down when processBlock runs over budget and back up once there
+    is headroom again. Stepping down reacts within a fraction of a second,
+    stepping up waits for a few seconds under half the budget, so the level
+    does not oscillate around the limit. A step up that has to be undone
+    right away doubles that wait. The audio thread only measures and
+    moves the level, the owner applies it on the message thread.
+
+  ==============================================================================
+*/
+#pragma once
+
+#include <atomic>
+#include "../JuceLibraryCode/JuceHeader.h"
+
+class QualityGovernor : private AsyncUpdater
+{
+public:
+    //from full quality to the cheapest setting
+    enum Level {
+        levelFull = 0,
+        levelLargerHop,
+        levelCheapTracker,
+        levelMinimal,
+        numLevels,
+    };
+
+    //message thread, with the new level
+    std::function<void (int)> onLevelChange;
+
+    ~QualityGovernor()
+    {
+        cancelPendingUpdate();
+    }
+
+    void prepare (double newSampleRate)
+    {
+        sampleRate = newSampleRate;
+        reset();
+    }
+
+    void reset()
+    {
+        smoothedLoad = 0.0;
+        secondsSinceChange = 0.0;
+        secondsUnderBudget = 0.0;
+        stepUpHoldTime = minStepUpHoldTime;
+        lastStepWasUp = false;
+    }
+
+    //share of the block deadline this instance may use, 0 to 1
+    void setBudget (float newBudget)
+    {
+        budget = jlimit (0.01, 1.0, (double)newBudget);
+    }
+
+    //audio thread, after every block. disabling goes back to full quality
+    void update (int64 startTicks, int numSamples, bool enabled)
+    {
+        if (!enabled) {
+            reset();
+            setLevel (levelFull);
+            return;
+        }
+
+        if (numSamples <= 0 || sampleRate <= 0.0)
+            return;
+
+        const double deadline = (double)numSamples / sampleRate;
+        const double elapsed = Time::highResolutionTicksToSeconds (Time::getHighResolutionTicks() - startTicks);
+
+        //one pole smoothing with a time constant in seconds rather than blocks
+        const double coefficient = 1.0 - std::exp (-deadline / loadTimeConstant);
+        smoothedLoad += coefficient * (elapsed / deadline - smoothedLoad);
+
+        secondsSinceChange += deadline;
+        if (smoothedLoad < stepUpFraction * budget)
+            secondsUnderBudget += deadline;
+        else
+            secondsUnderBudget = 0.0;
+
+        const int current = level.load();
+        if (smoothedLoad > budget && current < numLevels - 1 && secondsSinceChange > stepDownHoldTime) {
+            if (lastStepWasUp && secondsSinceChange < stepUpHoldTime)
+                stepUpHoldTime = jmin (maxStepUpHoldTime, 2.0 * stepUpHoldTime);
+            lastStepWasUp = false;
+            setLevel (current + 1);
+        }
+        else if (current > levelFull && secondsUnderBudget > stepUpHoldTime) {
+            lastStepWasUp = true;
+            setLevel (current - 1);
+        }
+        else if (secondsSinceChange > maxStepUpHoldTime) {
+            stepUpHoldTime = minStepUpHoldTime;
+        }
+    }
+
+    int getLevel() const
+    {
+        return level.load();
+    }
+
+    //smoothed share of the block deadline spent in processBlock
+    double getLoad() const
+    {
+        return smoothedLoad;
+    }
+
+private:
+    void setLevel (int newLevel)
+    {
+        if (level.exchange (newLevel) != newLevel) {
+            secondsSinceChange = 0.0;
+            secondsUnderBudget = 0.0;
+            triggerAsyncUpdate();
+        }
+    }
+
+    void handleAsyncUpdate() override
+    {
+        if (onLevelChange != nullptr)
+            onLevelChange (level.load());
+    }
+
+    //seconds
+    static constexpr double loadTimeConstant = 0.1;
+    static constexpr double stepDownHoldTime = 0.25;
+    static constexpr double minStepUpHoldTime = 3.0;
+    static constexpr double maxStepUpHoldTime = 60.0;
+    //share of the budget the load has to stay under before stepping back up
+    static constexpr double stepUpFraction = 0.5;
+
+    double sampleRate = 44100.0;
+    double budget = 0.25;
+    double smoothedLoad = 0.0;
+    double secondsSinceChange = 0.0;
+    double secondsUnderBudget = 0.0;
+    double stepUpHoldTime = minStepUpHoldTime;
+    bool lastStepWasUp = false;
+    std::atomic<int> level { levelFull };
+};
@@ -0,0 +1,757 @@
+/*
+  ==============================================================================
+
+    RegressionHarness.h
+    Author:  Sami S
+
+    Golden-output regression check for the DSP core. Fixed test signals
+    (a log sweep, a synthetic vowel with vibrato, and recorded vocals the
+    caller loads) are played through HarmonizerEngine with a scripted note
+    sequence. The rendered output of a candidate build is compared against
+    a reference render by SNR, log-spectral distance and the pitch of the
+    output, and fails when any of them is outside the budget. The reference
+    is either another engine in the same process (a different fft backend,
+    say) or golden files written by a known good build, which is what
+    covers rewrites of the bin loop or of YIN::calculatePitch.
+
+    Everything is deterministic: no random numbers, fixed block sizes and
+    the YIN tracker. Plain C++, so a console runner or CI job can link it
+    with the engine alone. The console target runs it with
+
+        harmonizer --regression [--golden dir] [--record dir]
+                                [--vocals take.raw [--script take.txt]]...
+
+    which renders every case through the juce fft (the reference) and the
+    vendored one, compares with the golden renders in dir if given, and
+    checks that a shifted burst lines up with the dry one and that both
+    come out at the latency the engine reports (see checkAlignment and
+    checkLatency), checks that breathy input falls below the voicing gate
+    (see checkVoicing), and exits with 1 when anything is over budget,
+    misaligned or missing. --record dir
+    writes the golden renders instead, from a build whose sound is known
+    good: record once from the last release, keep the directory with the
+    CI job, and run --golden against it for every change. Recorded vocals
+    are mono float32 raw files at --rate (44100 unless given), their
+    scripts text files in PcmStream's format ("<seconds> on <note>" and
+    "<seconds> off <note>" lines).
+
+  ==============================================================================
+*/
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "HarmonizerEngine.h"
+#include "StockhamFFT.h"
+#include "Yin.h"
+
+struct RegressionHarness
+{
+    //a note change at a time into the render, -1 releases
+    struct ScriptEvent
+    {
+        double seconds;
+        int note;
+    };
+
+    struct TestCase
+    {
+        std::string name;
+        HarmonizerEngine::Config config;
+        //mono, channel 0 gets it as is and the others at half the level
+        std::vector<float> signal;
+        std::vector<ScriptEvent> script;
+    };
+
+    //how far a candidate may drift from the reference
+    struct Budget
+    {
+        //a constructor rather than member initialisers, so Budget() can be a default argument below
+        Budget() : minSnrDb (60.0f), maxSpectralDistanceDb (0.5f), maxPitchErrorCents (5.0f)
+        {
+        }
+
+        float minSnrDb;
+        float maxSpectralDistanceDb;
+        float maxPitchErrorCents;
+    };
+
+    struct Result
+    {
+        std::string name;
+        float snrDb = 0.0f;
+        float spectralDistanceDb = 0.0f;
+        float pitchErrorCents = 0.0f;
+        bool passed = false;
+    };
+
+    //a property of the engine checked on its own, such as its latency
+    struct Check
+    {
+        std::string name;
+        std::string detail;
+        bool passed = false;
+    };
+
+    struct Report
+    {
+        std::vector<Result> results;
+        std::vector<Check> checks;
+        //missing or unreadable golden files, mismatched lengths, cases without a signal
+        std::vector<std::string> errors;
+
+        bool passed() const
+        {
+            if (!errors.empty())
+                return false;
+            for (auto& result : results)
+                if (!result.passed)
+                    return false;
+            for (auto& check : checks)
+                if (!check.passed)
+                    return false;
+            return true;
+        }
+
+        void add (const Report& other)
+        {
+            results.insert (results.end(), other.results.begin(), other.results.end());
+            checks.insert (checks.end(), other.checks.begin(), other.checks.end());
+            errors.insert (errors.end(), other.errors.begin(), other.errors.end());
+        }
+
+        std::string toString() const
+        {
+            std::ostringstream text;
+            text << "Regression harness: " << (passed() ? "passed" : "FAILED") << "\n";
+            text << std::left << std::setw (24) << "case" << std::setw (12) << "SNR dB"
+                 << std::setw (16) << "spectral dB" << std::setw (16) << "pitch cents" << "\n";
+
+            for (auto& result : results)
+                text << std::left << std::setw (24) << result.name << std::fixed << std::setprecision (2)
+                     << std::setw (12) << result.snrDb << std::setw (16) << result.spectralDistanceDb
+                     << std::setw (16) << result.pitchErrorCents << (result.passed ? "" : "over budget") << "\n";
+
+            for (auto& check : checks)
+                text << std::left << std::setw (24) << check.name << check.detail << (check.passed ? "" : "  FAILED") << "\n";
+
+            for (auto& error : errors)
+                text << error << "\n";
+            return text.str();
+        }
+    };
+
+    //channels x samples, latency included
+    using Render = std::vector<std::vector<float>>;
+
+    //==============================================================================
+    //the standard set, recorded vocals are added with makeRecordingCase
+    static std::vector<TestCase> getDefaultCases (double sampleRate = 44100.0)
+    {
+        std::vector<TestCase> cases;
+        const std::vector<ScriptEvent> thirds { { 0.0, 60 }, { 0.5, 64 }, { 1.0, 67 }, { 1.5, -1 }, { 1.75, 72 } };
+        const std::vector<ScriptEvent> held { { 0.0, 57 } };
+
+        for (int fftSize : { 512, 2048 }) {
+            HarmonizerEngine::Config config;
+            config.sampleRate = sampleRate;
+            config.fftSize = fftSize;
+
+            const std::string suffix = " " + std::to_string (fftSize);
+            cases.push_back ({ "sweep" + suffix, config, makeSweep (sampleRate, 2.5, 80.0, 800.0), held });
+            cases.push_back ({ "vowel" + suffix, config, makeVowel (sampleRate, 2.5, 196.0), thirds });
+        }
+
+        //the lowest quality the governor goes down to
+        HarmonizerEngine::Config light;
+        light.sampleRate = sampleRate;
+        light.overlap = 2;
+        cases.push_back ({ "vowel overlap 2", light, makeVowel (sampleRate, 2.5, 220.0), thirds });
+
+        return cases;
+    }
+
+    //a recording as mono float32 raw samples. a file that cannot be read leaves the signal empty, which every
+    //run below reports as an error rather than rendering silence
+    static TestCase makeRecordingCase (const std::string& name, const std::string& rawFile, double sampleRate)
+    {
+        TestCase test;
+        test.name = name;
+        test.config.sampleRate = sampleRate;
+        test.config.fftSize = 1024;
+        test.script = { { 0.0, 60 }, { 1.0, 65 }, { 2.0, 67 }, { 3.0, 64 } };
+
+        std::ifstream file (rawFile, std::ios::binary | std::ios::ate);
+        if (file) {
+            const auto numBytes = (std::streamsize)file.tellg();
+            test.signal.resize ((size_t)numBytes / sizeof (float));
+            file.seekg (0);
+            file.read ((char*)test.signal.data(), (std::streamsize)(test.signal.size() * sizeof (float)));
+        }
+        return test;
+    }
+
+    //a script in PcmStream's text format. an off only releases the note it names if that is the one playing
+    static bool loadScript (const std::string& path, std::vector<ScriptEvent>& script)
+    {
+        std::ifstream file (path);
+        if (!file)
+            return false;
+
+        script.clear();
+        int playing = -1;
+        std::string line;
+        while (std::getline (file, line)) {
+            line = line.substr (0, line.find ('#'));
+            std::istringstream tokens (line);
+            double seconds = 0.0;
+            std::string type;
+            int note = 0;
+            if (!(tokens >> seconds))
+                continue;
+            if (!(tokens >> type >> note) || (type != "on" && type != "off"))
+                return false;
+
+            if (type == "on")
+                playing = note;
+            else if (note == playing)
+                playing = -1;
+            else
+                continue;
+            script.push_back ({ seconds, playing });
+        }
+
+        std::stable_sort (script.begin(), script.end(), [](const ScriptEvent& a, const ScriptEvent& b) { return a.seconds < b.seconds; });
+        return true;
+    }
+
+    //exponential sweep, half scale
+    static std::vector<float> makeSweep (double sampleRate, double seconds, double startHz, double endHz)
+    {
+        const int numSamples = (int)(sampleRate * seconds);
+        const double rate = std::log (endHz / startHz) / seconds;
+        std::vector<float> signal (numSamples);
+
+        for (int sample = 0; sample < numSamples; ++sample) {
+            const double t = sample / sampleRate;
+            const double phase = 2.0 * pi * startHz * (std::exp (rate * t) - 1.0) / rate;
+            signal[sample] = 0.5f * (float)std::sin (phase);
+        }
+        return signal;
+    }
+
+    //additive /a/: harmonics of a 5 Hz, 30 cent vibrato shaped by three formants, with a short fade in and out
+    static std::vector<float> makeVowel (double sampleRate, double seconds, double fundamental)
+    {
+        static const double formants[3][2] = { { 730.0, 90.0 }, { 1090.0, 110.0 }, { 2440.0, 170.0 } };
+        const int numSamples = (int)(sampleRate * seconds);
+        const int numHarmonics = std::max (1, (int)(4000.0 / fundamental));
+
+        std::vector<double> amplitudes (numHarmonics);
+        double amplitudeSum = 0.0;
+        for (int harmonic = 1; harmonic <= numHarmonics; ++harmonic) {
+            double gain = 0.0;
+            for (auto& formant : formants) {
+                const double distance = (harmonic * fundamental - formant[0]) / formant[1];
+                gain += 1.0 / (1.0 + distance * distance);
+            }
+            amplitudes[harmonic - 1] = (0.1 + gain) / harmonic;
+            amplitudeSum += amplitudes[harmonic - 1];
+        }
+
+        std::vector<float> signal (numSamples);
+        const int fadeLength = (int)(0.02 * sampleRate);
+        double phase = 0.0;
+
+        for (int sample = 0; sample < numSamples; ++sample) {
+            const double t = sample / sampleRate;
+            const double frequency = fundamental * std::pow (2.0, 0.3 / 12.0 * std::sin (2.0 * pi * 5.0 * t));
+            phase += 2.0 * pi * frequency / sampleRate;
+
+            double value = 0.0;
+            for (int harmonic = 1; harmonic <= numHarmonics; ++harmonic)
+                value += amplitudes[harmonic - 1] * std::sin (harmonic * phase);
+
+            const int edge = std::min (sample, numSamples - 1 - sample);
+            const double fade = edge < fadeLength ? (double)edge / fadeLength : 1.0;
+            signal[sample] = (float)(0.5 * fade * value / amplitudeSum);
+        }
+        return signal;
+    }
+
+    //==============================================================================
+    //not realtime, renders signal plus latency so the tail is in. a null factory uses the engine's default
+    static Render render (const TestCase& test, const HarmonizerEngine::FFTFactory& fftFactory = nullptr)
+    {
+        HarmonizerEngine engine;
+        if (fftFactory)
+            engine.setFFTFactory (fftFactory);
+        engine.prepare (test.config);
+        engine.setGate (-90.0f, 100.0f);
+
+        const auto& config = engine.getConfig();
+        YinPitchDetector tracker;
+        tracker.prepare (config.sampleRate, config.maxBlockSize);
+        tracker.setThreshold (0.15f);
+        engine.setPitchDetector (&tracker);
+
+        const int numSamples = (int)test.signal.size() + engine.getLatencySamples();
+        Render output (config.numChannels, std::vector<float> (numSamples, 0.0f));
+        std::vector<std::vector<float>> input (config.numChannels, std::vector<float> (config.maxBlockSize, 0.0f));
+        std::vector<const float*> inputs (config.numChannels);
+        std::vector<float*> outputs (config.numChannels);
+
+        size_t nextEvent = 0;
+        for (int start = 0; start < numSamples; start += config.maxBlockSize) {
+            const int length = std::min (config.maxBlockSize, numSamples - start);
+
+            while (nextEvent < test.script.size() && test.script[nextEvent].seconds * config.sampleRate <= start)
+                engine.setPlayedNote (test.script[nextEvent++].note);
+
+            for (int channel = 0; channel < config.numChannels; ++channel) {
+                const float gain = channel == 0 ? 1.0f : 0.5f;
+                for (int sample = 0; sample < length; ++sample) {
+                    const int index = start + sample;
+                    input[channel][sample] = index < (int)test.signal.size() ? gain * test.signal[index] : 0.0f;
+                }
+                inputs[channel] = input[channel].data();
+                outputs[channel] = output[channel].data() + start;
+            }
+
+            engine.process (inputs.data(), outputs.data(), length);
+        }
+
+        return output;
+    }
+
+    static Result compare (const std::string& name, const Render& reference, const Render& candidate, const Budget& budget,
+                           double sampleRate = 44100.0)
+    {
+        Result result;
+        result.name = name;
+
+        double signalEnergy = 0.0, errorEnergy = 0.0, spectralSum = 0.0, pitchSum = 0.0;
+        int numSpectralFrames = 0, numPitchFrames = 0;
+
+        for (size_t channel = 0; channel < reference.size(); ++channel) {
+            const auto& ref = reference[channel];
+            const auto& test = candidate[channel];
+
+            for (size_t sample = 0; sample < ref.size(); ++sample) {
+                const double error = (double)ref[sample] - test[sample];
+                signalEnergy += (double)ref[sample] * ref[sample];
+                errorEnergy += error * error;
+            }
+
+            spectralSum += spectralDistance (ref, test, numSpectralFrames);
+        }
+
+        //the tracker only ever looks at channel 0, so neither does this
+        pitchSum = pitchError (reference[0], candidate[0], sampleRate, numPitchFrames);
+
+        result.snrDb = errorEnergy > 0.0 ? (float)(10.0 * std::log10 (signalEnergy / errorEnergy)) : 999.0f;
+        result.spectralDistanceDb = numSpectralFrames > 0 ? (float)(spectralSum / numSpectralFrames) : 0.0f;
+        result.pitchErrorCents = numPitchFrames > 0 ? (float)(pitchSum / numPitchFrames) : 0.0f;
+        result.passed = result.snrDb >= budget.minSnrDb && result.spectralDistanceDb <= budget.maxSpectralDistanceDb
+                     && result.pitchErrorCents <= budget.maxPitchErrorCents;
+        return result;
+    }
+
+    //==============================================================================
+    //same cases rendered with two ffts in this process
+    static Report compareBackends (const HarmonizerEngine::FFTFactory& reference, const HarmonizerEngine::FFTFactory& candidate,
+                                   const std::vector<TestCase>& cases = getDefaultCases(), const Budget& budget = Budget())
+    {
+        Report report;
+        for (auto& test : cases)
+            if (hasSignal (test, report))
+                report.results.push_back (compare (test.name, render (test, reference), render (test, candidate), budget,
+                                                   test.config.sampleRate));
+        return report;
+    }
+
+    //writes one golden file per case into directory, from a build whose sound is known good
+    static Report recordGolden (const std::string& directory, const std::vector<TestCase>& cases = getDefaultCases(),
+                                const HarmonizerEngine::FFTFactory& fftFactory = nullptr)
+    {
+        Report report;
+        for (auto& test : cases)
+            if (hasSignal (test, report) && !writeRender (getGoldenPath (directory, test.name), render (test, fftFactory)))
+                report.errors.push_back ("cannot write golden file for " + test.name);
+        return report;
+    }
+
+    //renders with this build and compares against the golden files
+    static Report compareWithGolden (const std::string& directory, const std::vector<TestCase>& cases = getDefaultCases(),
+                                     const HarmonizerEngine::FFTFactory& fftFactory = nullptr, const Budget& budget = Budget())
+    {
+        Report report;
+        for (auto& test : cases) {
+            if (!hasSignal (test, report))
+                continue;
+
+            Render golden;
+            if (!readRender (getGoldenPath (directory, test.name), golden)) {
+                report.errors.push_back ("no golden file for " + test.name);
+                continue;
+            }
+
+            Render candidate = render (test, fftFactory);
+            if (golden.size() != candidate.size() || golden[0].size() != candidate[0].size()) {
+                report.errors.push_back ("golden file of " + test.name + " has a different layout or length");
+                continue;
+            }
+
+            report.results.push_back (compare (test.name + " (golden)", golden, candidate, budget, test.config.sampleRate));
+        }
+        return report;
+    }
+
+    //a tone burst shifted up and down a whole tone and a fifth has to come out within a hop of the same burst
+    //passed through dry, at every fft size, so a mix of the two does not smear
+    static Report checkAlignment (const HarmonizerEngine::FFTFactory& fftFactory = nullptr)
+    {
+        Report report;
+        for (int fftSize : { 512, 1024, 2048 }) {
+            const int hopSize = fftSize / alignmentOverlap;
+            const double dryLag = measureLag (fftSize, alignmentOverlap, -1, fftFactory);
+            Check check { "alignment " + std::to_string (fftSize), "dry " + formatLag (dryLag) + ", wet", dryLag >= 0.0 };
+
+            for (int note : { 62, 58, 67, 53 }) {
+                const double wetLag = measureLag (fftSize, alignmentOverlap, note, fftFactory);
+                check.detail += " " + formatLag (wetLag);
+                check.passed = check.passed && wetLag >= 0.0 && std::abs (wetLag - dryLag) <= hopSize;
+            }
+
+            check.detail += " (hop " + std::to_string (hopSize) + ")";
+            report.checks.push_back (check);
+        }
+        return report;
+    }
+
+    //the latency the engine reports, which the host compensates, has to be the delay of the dry signal to the sample
+    //and that of a burst shifted up and down a third to within a hop, whatever the fft size and overlap
+    static Report checkLatency (const HarmonizerEngine::FFTFactory& fftFactory = nullptr)
+    {
+        Report report;
+        for (int fftSize : { 512, 1024, 2048 }) {
+            for (int overlap : { 2, 8 }) {
+                const int latency = HarmonizerEngine::getLatencySamples (fftSize);
+                const int hopSize = fftSize / overlap;
+                const double dryLag = measureLag (fftSize, overlap, -1, fftFactory);
+                const double upLag = measureLag (fftSize, overlap, 64, fftFactory);
+                const double downLag = measureLag (fftSize, overlap, 56, fftFactory);
+                const bool passed = dryLag >= 0.0 && upLag >= 0.0 && downLag >= 0.0 && std::abs (dryLag - latency) <= 1.0
+                                    && std::abs (0.5 * (upLag + downLag) - latency) <= hopSize;
+
+                report.checks.push_back ({ "latency " + std::to_string (fftSize) + "/" + std::to_string (overlap),
+                                           "reported " + std::to_string (latency) + ", dry " + formatLag (dryLag) + ", wet "
+                                               + formatLag (upLag) + " " + formatLag (downLag) + " (hop " + std::to_string (hopSize) + ")",
+                                           passed });
+            }
+        }
+        return report;
+    }
+
+    //YIN's confidence behind the note tracker's default gate: a clean vowel has to be voiced nearly throughout,
+    //the same vowel breathed over with noise, whose dips YIN still finds under its threshold, and noise alone
+    //hardly ever. the noise comes from a fixed seed, so the check is as deterministic as the rest
+    static Report checkVoicing()
+    {
+        Report report;
+        const double sampleRate = 44100.0;
+        const std::vector<float> vowel = makeVowel (sampleRate, 2.0, 200.0);
+
+        struct Voicing { const char* name; float vowelGain, noiseGain; bool shouldBeVoiced; };
+        for (const Voicing& voicing : { Voicing { "voicing clean", 1.0f, 0.0f, true },
+                                        Voicing { "voicing breathy", 1.0f, 0.07f, false },
+                                        Voicing { "voicing noise", 0.0f, 0.3f, false } }) {
+            std::vector<float> signal (vowel.size());
+            uint32_t seed = 1;
+            for (size_t sample = 0; sample < signal.size(); ++sample) {
+                seed = seed * 1664525u + 1013904223u;
+                signal[sample] = voicing.vowelGain * vowel[sample] + voicing.noiseGain * ((float)(seed >> 8) / 8388608.0f - 1.0f);
+            }
+
+            const int blockSize = 512;
+            YinPitchDetector tracker;
+            tracker.prepare (sampleRate, blockSize);
+            tracker.setThreshold (0.15f);
+            NoteTracker noteTracker;
+            noteTracker.prepare (sampleRate);
+
+            int numBlocks = 0, numDetected = 0, numVoiced = 0;
+            for (size_t start = 0; start + blockSize <= signal.size(); start += blockSize) {
+                tracker.pushSamples (signal.data() + start, blockSize);
+                const PitchEstimate estimate = tracker.getPitch();
+                ++numBlocks;
+                numDetected += estimate.frequency > 0.0f ? 1 : 0;
+                numVoiced += noteTracker.update (estimate, blockSize) >= 0 ? 1 : 0;
+            }
+
+            const double voicedShare = (double)numVoiced / numBlocks;
+            report.checks.push_back ({ voicing.name, "periods in " + std::to_string (numDetected) + " of " + std::to_string (numBlocks)
+                                                         + " blocks, voiced " + std::to_string (numVoiced),
+                                       voicing.shouldBeVoiced ? voicedShare >= 0.9 : voicedShare <= 0.1 });
+        }
+        return report;
+    }
+
+    //==============================================================================
+    //the options are listed above, argv[0] is skipped. prints the report, returns the exit code
+    static int runFromCommandLine (int argc, char* argv[], const HarmonizerEngine::FFTFactory& reference,
+                                   const HarmonizerEngine::FFTFactory& candidate)
+    {
+        std::string goldenDirectory, recordDirectory;
+        double sampleRate = 44100.0;
+        std::vector<TestCase> cases = getDefaultCases();
+        const size_t numDefaultCases = cases.size();
+
+        for (int i = 1; i < argc; i += 2) {
+            const std::string flag = argv[i];
+            if (i + 1 >= argc) {
+                std::fprintf (stderr, "missing value for %s\n", flag.c_str());
+                return 2;
+            }
+
+            const std::string value = argv[i + 1];
+            if (flag == "--golden") {
+                goldenDirectory = value;
+            }
+            else if (flag == "--record") {
+                recordDirectory = value;
+            }
+            else if (flag == "--rate") {
+                sampleRate = std::atof (value.c_str());
+            }
+            else if (flag == "--vocals") {
+                //named by the file, so its golden file lands next to the others whatever directory it came from
+                cases.push_back (makeRecordingCase (value.substr (value.find_last_of ("/\\") + 1), value, sampleRate));
+            }
+            else if (flag == "--script" && cases.size() > numDefaultCases) {
+                if (!loadScript (value, cases.back().script)) {
+                    std::fprintf (stderr, "cannot read script %s\n", value.c_str());
+                    return 2;
+                }
+            }
+            else {
+                std::fprintf (stderr, "unknown option %s %s\n", flag.c_str(), value.c_str());
+                return 2;
+            }
+        }
+
+        Report report;
+        if (!recordDirectory.empty()) {
+            report = recordGolden (recordDirectory, cases, candidate);
+        }
+        else {
+            report = compareBackends (reference, candidate, cases);
+            report.add (checkAlignment (candidate));
+            report.add (checkLatency (candidate));
+            report.add (checkVoicing());
+            if (!goldenDirectory.empty())
+                report.add (compareWithGolden (goldenDirectory, cases, candidate));
+        }
+
+        std::fprintf (stdout, "%s", report.toString().c_str());
+        return report.passed() ? 0 : 1;
+    }
+
+private:
+    //an empty signal renders only the latency's worth of silence, which would compare as a perfect match
+    static bool hasSignal (const TestCase& test, Report& report)
+    {
+        if (!test.signal.empty())
+            return true;
+
+        report.errors.push_back ("no test signal for " + test.name);
+        return false;
+    }
+
+    //mean over frames of the rms difference of the log magnitudes, frames of 1024 with a hop of 512
+    static double spectralDistance (const std::vector<float>& reference, const std::vector<float>& candidate, int& numFrames)
+    {
+        const int order = 10;
+        const int size = 1 << order;
+        StockhamFFT fft (order);
+        std::vector<float> window (size);
+        for (int sample = 0; sample < size; ++sample)
+            window[sample] = 0.5f - 0.5f * (float)std::cos (2.0 * pi * sample / (size - 1));
+
+        std::vector<float> ref (2 * size), test (2 * size);
+        double sum = 0.0;
+
+        for (size_t start = 0; start + size <= reference.size(); start += size / 2) {
+            double frameEnergy = 0.0;
+            for (int sample = 0; sample < size; ++sample) {
+                ref[sample] = reference[start + sample] * window[sample];
+                test[sample] = candidate[start + sample] * window[sample];
+                frameEnergy += (double)ref[sample] * ref[sample];
+            }
+
+            //silence would only compare noise floors
+            if (frameEnergy < 1.0e-6)
+                continue;
+
+            fft.performRealOnlyForwardTransform (ref.data());
+            fft.performRealOnlyForwardTransform (test.data());
+
+            double frameSum = 0.0;
+            for (int bin = 0; bin <= size / 2; ++bin) {
+                const double refMagnitude = std::hypot (ref[2 * bin], ref[2 * bin + 1]);
+                const double testMagnitude = std::hypot (test[2 * bin], test[2 * bin + 1]);
+                const double difference = 20.0 * std::log10 ((refMagnitude + 1.0e-5) / (testMagnitude + 1.0e-5));
+                frameSum += difference * difference;
+            }
+
+            sum += std::sqrt (frameSum / (size / 2 + 1));
+            ++numFrames;
+        }
+        return sum;
+    }
+
+    //summed cents between the pitch of both outputs, over blocks voiced in both
+    static double pitchError (const std::vector<float>& reference, const std::vector<float>& candidate, double sampleRate,
+                              int& numFrames)
+    {
+        const int blockSize = 1024;
+        YinPitchDetector refTracker, testTracker;
+        refTracker.prepare (sampleRate, blockSize);
+        testTracker.prepare (sampleRate, blockSize);
+        refTracker.setThreshold (0.15f);
+        testTracker.setThreshold (0.15f);
+
+        double sum = 0.0;
+        for (size_t start = 0; start + blockSize <= reference.size(); start += blockSize) {
+            refTracker.pushSamples (reference.data() + start, blockSize);
+            testTracker.pushSamples (candidate.data() + start, blockSize);
+            const float refFrequency = refTracker.getPitch().frequency;
+            const float testFrequency = testTracker.getPitch().frequency;
+
+            if (refFrequency > 0.0f && testFrequency > 0.0f) {
+                sum += 1200.0 * std::fabs (std::log2 ((double)testFrequency / refFrequency));
+                ++numFrames;
+            }
+        }
+        return sum;
+    }
+
+    //==============================================================================
+    //samples from a 261.63 Hz burst going in to it coming out, played at note (-1 passes it through dry), the voice
+    //fixed at 60. the lag is the mean of the rise's and the fall's half level crossings of the energy over a window,
+    //since a shifted burst smears at both ends alike. -1 when nothing comes out
+    static double measureLag (int fftSize, int overlap, int note, const HarmonizerEngine::FFTFactory& fftFactory)
+    {
+        HarmonizerEngine engine;
+        if (fftFactory)
+            engine.setFFTFactory (fftFactory);
+
+        HarmonizerEngine::Config config;
+        config.numChannels = 1;
+        config.fftSize = fftSize;
+        config.overlap = overlap;
+        config.maxBlockSize = 256;
+        //the default gate, one down at -90 dB lets the shifted burst ring on past its fall
+        engine.prepare (config);
+        engine.setPlayedNote (note);
+
+        const double frequency = 261.63;
+        const int burstStart = 8192, burstLength = (int)(0.2 * config.sampleRate), numSamples = 32768;
+        std::vector<float> input ((size_t)numSamples, 0.0f), output ((size_t)numSamples, 0.0f);
+        for (int sample = 0; sample < burstLength; ++sample)
+            input[(size_t)(burstStart + sample)] = (float)(0.5 * std::sin (2.0 * pi * frequency * sample / config.sampleRate));
+
+        for (int start = 0; start < numSamples; start += config.maxBlockSize) {
+            const float* inputs[] = { input.data() + start };
+            float* outputs[] = { output.data() + start };
+            engine.process (inputs, outputs, config.maxBlockSize, { (float)frequency, 1.0f });
+        }
+
+        double inputRise, inputFall, outputRise, outputFall;
+        if (!findEdges (input, fftSize, inputRise, inputFall) || !findEdges (output, fftSize, outputRise, outputFall))
+            return -1.0;
+        return 0.5 * ((outputRise - inputRise) + (outputFall - inputFall));
+    }
+
+    //half level crossings of the energy over windowLength, the level being the burst's plateau
+    static bool findEdges (const std::vector<float>& signal, int windowLength, double& rise, double& fall)
+    {
+        std::vector<double> energy (signal.size(), 0.0);
+        double sum = 0.0;
+        for (size_t sample = 0; sample < signal.size(); ++sample) {
+            sum += (double)signal[sample] * signal[sample];
+            if (sample >= (size_t)windowLength)
+                sum -= (double)signal[sample - (size_t)windowLength] * signal[sample - (size_t)windowLength];
+            energy[sample] = sum;
+        }
+
+        //the median of the loudest samples, so an overshoot at the onset does not set the level
+        std::vector<double> sorted (energy);
+        std::sort (sorted.begin(), sorted.end());
+        const double level = 0.5 * sorted[sorted.size() - 2000];
+        if (level <= 0.0)
+            return false;
+
+        size_t first = 0, last = energy.size() - 1;
+        while (energy[first] < level)
+            ++first;
+        while (energy[last] < level)
+            --last;
+        rise = (double)first;
+        fall = (double)last;
+        return true;
+    }
+
+    static std::string formatLag (double lag)
+    {
+        return lag < 0.0 ? "none" : std::to_string ((int)std::lround (lag));
+    }
+
+    //==============================================================================
+    //"HRG1", channels, samples, then channel after channel of float32
+    static std::string getGoldenPath (const std::string& directory, const std::string& name)
+    {
+        std::string fileName = name;
+        std::replace (fileName.begin(), fileName.end(), ' ', '_');
+        return directory + "/" + fileName + ".golden";
+    }
+
+    static bool writeRender (const std::string& path, const Render& render)
+    {
+        std::ofstream file (path, std::ios::binary);
+        if (!file || render.empty())
+            return false;
+
+        const uint32_t header[3] = { fileTag, (uint32_t)render.size(), (uint32_t)render[0].size() };
+        file.write ((const char*)header, sizeof (header));
+        for (auto& channel : render)
+            file.write ((const char*)channel.data(), (std::streamsize)(channel.size() * sizeof (float)));
+        return (bool)file;
+    }
+
+    static bool readRender (const std::string& path, Render& render)
+    {
+        std::ifstream file (path, std::ios::binary);
+        uint32_t header[3] = {};
+        if (!file.read ((char*)header, sizeof (header)) || header[0] != fileTag || header[1] == 0)
+            return false;
+
+        render.assign (header[1], std::vector<float> (header[2]));
+        for (auto& channel : render)
+            if (!file.read ((char*)channel.data(), (std::streamsize)(channel.size() * sizeof (float))))
+                return false;
+        return true;
+    }
+
+    static constexpr uint32_t fileTag = 0x31475248;
+    static constexpr int alignmentOverlap = 4;
+    static constexpr double pi = 3.14159265358979323846;
+};
@@ -0,0 +1,402 @@
+/*
+  ==============================================================================
+
+    SegmentRender.h
+    Author:  Sami S
+
+    Offline render of one long file on several cores. The input is split
+    into segments, each starting warmUpSeconds before its cut with a fresh
+    engine and tracker, which is thrown away again, and running
+    overlapSeconds past its end. The cuts are on the grid of the hop and the
+    block size, so a segment's engine runs the same frames and blocks as a
+    serial render would. The segments render side by side and are joined in
+    the overlaps.
+
+    The vocoder's phases depend on everything since they last started over,
+    so a segment only sounds like the serial render once both have restarted
+    them: at a change of the played note, or after silence long enough for
+    the gate to close. Cuts are therefore only made just before such a
+    restart, within searchSeconds of where an even split would put them.
+    Where there is none, as in a long held note, there is no cut and the
+    segments are fewer, down to one serial render. From the restart on both
+    renders are the same samples, and the join is made after that point.
+    A join that still has not converged by the end of the overlap merges the
+    two segments, which render again as one.
+
+    So every join is exact: past each join the output is the serial
+    render's own, and up to it the previous segment's, which agrees with
+    the serial render to within joinTolerance per sample. compareWithSerial
+    measures it against the regression harness's default budget.
+
+    Plain C++ on std::thread, like the harness it links with the engine
+    alone. HarmonizerAudioProcessor::renderSegmented sets the engines up
+    from its params and its MIDI.
+
+  ==============================================================================
+*/
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <numeric>
+#include <thread>
+#include <vector>
+#include "HarmonizerEngine.h"
+#include "RegressionHarness.h"
+
+struct SegmentRender
+{
+    //a change of the played note, from the first block starting at or after sample. -1 releases
+    struct NoteEvent
+    {
+        int64_t sample;
+        int note;
+    };
+
+    struct Options
+    {
+        //shortest segment worth a thread, the warm-up and the overlap are paid once per segment
+        double minSegmentSeconds = 20.0;
+        //how far a cut may move either way to reach a restart of the phases
+        double searchSeconds = 5.0;
+        //rendered ahead of a cut to settle the tracker, the note tracker and the rings, then thrown away
+        double warmUpSeconds = 1.0;
+        //rendered past a segment's end, the join with the next segment is in it
+        double overlapSeconds = 2.0;
+        //samples closer than this count as converged
+        float joinTolerance = 1e-6f;
+        //0 for every hardware thread
+        int numThreads = 0;
+    };
+
+    struct Result
+    {
+        int numSegments = 0;
+        //joins that did not converge, each cost a segment rendered again
+        int numMerged = 0;
+    };
+
+    //sets up a prepared engine the way the serial render's is (gate, formants, note tracking, downmix)
+    //and returns the tracker for it, prepared. called once per segment on the thread rendering it
+    using EngineSetup = std::function<std::unique_ptr<PitchDetector> (HarmonizerEngine& engine)>;
+
+    //inputs and outputs have config.numChannels channels of numSamples. the output is shifted back by
+    //the latency, so it lines up with the input. config.maxBlockSize is the block size of the render
+    static Result render (const HarmonizerEngine::Config& config, const float* const* inputs, float* const* outputs,
+                          int numSamples, const std::vector<NoteEvent>& notes, const EngineSetup& setup,
+                          const HarmonizerEngine::FFTFactory& fftFactory = nullptr)
+    {
+        return render (config, inputs, outputs, numSamples, notes, setup, fftFactory, Options());
+    }
+
+    static Result render (const HarmonizerEngine::Config& config, const float* const* inputs, float* const* outputs,
+                          int numSamples, const std::vector<NoteEvent>& notes, const EngineSetup& setup,
+                          const HarmonizerEngine::FFTFactory& fftFactory, const Options& options)
+    {
+        Render render (config, inputs, outputs, numSamples, notes, setup, fftFactory, options);
+        render.plan();
+
+        std::vector<size_t> changed (render.segments.size());
+        std::iota (changed.begin(), changed.end(), (size_t)0);
+
+        //a join that has not converged merges its segments, which render again as one from the first one's
+        //begin. until every join converges, at worst into one serial segment
+        Result result;
+        while (!changed.empty()) {
+            render.renderSegments (changed);
+            changed.clear();
+
+            std::vector<Segment> joined;
+            for (auto& segment : render.segments) {
+                //a segment merged in this pass has no tail for its new end yet
+                const bool merged = !changed.empty() && changed.back() == joined.size() - 1;
+                if (!joined.empty() && !merged && render.findConvergence (joined.back(), segment) < 0) {
+                    joined.back().nextCut = segment.nextCut;
+                    joined.back().end = segment.end;
+                    changed.push_back (joined.size() - 1);
+                    ++result.numMerged;
+                }
+                else {
+                    joined.push_back (std::move (segment));
+                }
+            }
+            render.segments = std::move (joined);
+        }
+
+        result.numSegments = (int)render.segments.size();
+        for (size_t index = 1; index < render.segments.size(); ++index)
+            render.join (render.segments[index - 1], render.segments[index]);
+        return result;
+    }
+
+    //the reference: one segment on the calling thread
+    static void renderSerial (const HarmonizerEngine::Config& config, const float* const* inputs, float* const* outputs,
+                              int numSamples, const std::vector<NoteEvent>& notes, const EngineSetup& setup,
+                              const HarmonizerEngine::FFTFactory& fftFactory = nullptr)
+    {
+        const Options options;
+        Render render (config, inputs, outputs, numSamples, notes, setup, fftFactory, options);
+        render.planSerial();
+        render.renderSegment (render.segments[0]);
+    }
+
+    //how far a segmented render of inputs is from the serial one, against the harness's default budget
+    static RegressionHarness::Result compareWithSerial (const HarmonizerEngine::Config& config, const float* const* inputs,
+                                                        int numSamples, const std::vector<NoteEvent>& notes,
+                                                        const EngineSetup& setup, const Options& options)
+    {
+        RegressionHarness::Render serial (config.numChannels, std::vector<float> (numSamples, 0.0f));
+        RegressionHarness::Render segmented = serial;
+        std::vector<float*> serialOutputs, segmentedOutputs;
+        for (int channel = 0; channel < config.numChannels; ++channel) {
+            serialOutputs.push_back (serial[channel].data());
+            segmentedOutputs.push_back (segmented[channel].data());
+        }
+
+        renderSerial (config, inputs, serialOutputs.data(), numSamples, notes, setup);
+        render (config, inputs, segmentedOutputs.data(), numSamples, notes, setup, nullptr, options);
+        return RegressionHarness::compare ("segmented", serial, segmented, RegressionHarness::Budget(), config.sampleRate);
+    }
+
+    static int getNumThreads (const Options& options)
+    {
+        if (options.numThreads > 0)
+            return options.numThreads;
+        return std::max (1, (int)std::thread::hardware_concurrency());
+    }
+
+private:
+    //positions are on the engine's output timeline, the input padded with latency samples of silence
+    struct Segment
+    {
+        //rendered from begin to end, owns cut to next cut
+        int begin;
+        int cut;
+        int nextCut;
+        int end;
+        //numChannels x (end - nextCut) past the next cut, for the join
+        std::vector<std::vector<float>> tail;
+    };
+
+    struct Render
+    {
+        Render (const HarmonizerEngine::Config& renderConfig, const float* const* renderInputs, float* const* renderOutputs,
+                int renderNumSamples, const std::vector<NoteEvent>& renderNotes, const EngineSetup& renderSetup,
+                const HarmonizerEngine::FFTFactory& renderFFTFactory, const Options& renderOptions)
+            : config (renderConfig), inputs (renderInputs), outputs (renderOutputs), numSamples (renderNumSamples),
+              notes (renderNotes), setup (renderSetup), fftFactory (renderFFTFactory), options (renderOptions)
+        {
+        }
+
+        const HarmonizerEngine::Config& config;
+        const float* const* inputs;
+        float* const* outputs;
+        int numSamples;
+        const std::vector<NoteEvent>& notes;
+        const EngineSetup& setup;
+        const HarmonizerEngine::FFTFactory& fftFactory;
+        const Options& options;
+
+        std::vector<Segment> segments;
+        int latency = 0;
+        int length = 0;
+
+        void planSerial()
+        {
+            latency = HarmonizerEngine::getLatencySamples (config.fftSize);
+            length = numSamples + latency;
+            segments.push_back ({ 0, 0, length, length, {} });
+        }
+
+        //one segment per thread, at most one per minSegmentSeconds, and only cut before a restart
+        void plan()
+        {
+            planSerial();
+
+            //a segment starting on this grid gets the frames and blocks of the serial render
+            const int hopSize = std::max (1, config.fftSize / std::max (1, config.overlap));
+            const int grid = hopSize / std::gcd (hopSize, config.maxBlockSize) * config.maxBlockSize;
+            auto toGrid = [grid](double seconds, double sampleRate) {
+                return (int)std::ceil (seconds * sampleRate / grid) * grid;
+            };
+
+            const int minSegmentLength = std::max (grid, toGrid (options.minSegmentSeconds, config.sampleRate));
+            const int searchLength = toGrid (options.searchSeconds, config.sampleRate);
+            const int warmUpLength = toGrid (options.warmUpSeconds, config.sampleRate);
+            //the restart is less than a grid step past the cut, and a frame after it has to agree
+            const int overlapLength = std::max (grid + 4 * config.fftSize, toGrid (options.overlapSeconds, config.sampleRate));
+
+            const int numSegments = std::max (1, std::min (getNumThreads (options), length / minSegmentLength));
+            if (numSegments == 1)
+                return;
+
+            const std::vector<int> restarts = findRestarts (hopSize);
+            std::vector<int> cuts { 0 };
+            for (int index = 1; index < numSegments; ++index) {
+                //the grid step holding the restart nearest the even split
+                const int nominal = (int)((int64_t)length * index / numSegments);
+                int cut = -1;
+                for (int restart : restarts) {
+                    const int candidate = restart / grid * grid;
+                    if (std::abs (restart - nominal) > searchLength || candidate <= cuts.back() + overlapLength
+                        || candidate + overlapLength >= length)
+                        continue;
+                    if (cut < 0 || std::abs (candidate - nominal) < std::abs (cut - nominal))
+                        cut = candidate;
+                }
+                if (cut > 0)
+                    cuts.push_back (cut);
+            }
+            cuts.push_back (length);
+
+            segments.clear();
+            for (size_t index = 0; index + 1 < cuts.size(); ++index) {
+                const int begin = std::max (0, cuts[index] - warmUpLength);
+                const int end = std::min (length, cuts[index + 1] + overlapLength);
+                segments.push_back ({ begin, cuts[index], cuts[index + 1], end, {} });
+            }
+        }
+
+        //where a segment and the serial render both start their phases over, on the engine's timeline: a change
+        //of the played note, and the first frame after silence long enough for the gate to close
+        std::vector<int> findRestarts (int hopSize) const
+        {
+            std::vector<int> restarts;
+            for (size_t index = 0; index < notes.size(); ++index)
+                if (index == 0 || notes[index].note != notes[index - 1].note)
+                    restarts.push_back ((int)std::min<int64_t> (notes[index].sample, length));
+
+            //the gate as the segments' engines are set up. the downmix of a shared analysis is never gated
+            HarmonizerEngine probe;
+            probe.prepare (config);
+            setup (probe);
+            const double threshold = probe.getGateThreshold();
+            if (threshold > 0.0 && !config.sharedAnalysis) {
+                //the engine keeps a running sum, half its threshold leaves room for the rounding
+                const double quietEnergy = 0.5 * threshold * threshold * config.fftSize;
+                const int holdSamples = (int)(probe.getGateHoldMs() * 1e-3f * (float)config.sampleRate);
+                //quiet frames in a row for the hold to run out, and one to spare
+                const int framesToClose = holdSamples / hopSize + 2;
+
+                int numQuiet = 0;
+                for (int frame = hopSize; frame <= length; frame += hopSize) {
+                    //a frame sees the fftSize samples before it, in every channel
+                    bool quiet = true;
+                    for (int channel = 0; channel < config.numChannels && quiet; ++channel) {
+                        double energy = 0.0;
+                        for (int sample = std::max (0, frame - config.fftSize); sample < std::min (numSamples, frame); ++sample)
+                            energy += (double)inputs[channel][sample] * inputs[channel][sample];
+                        quiet = energy < quietEnergy;
+                    }
+
+                    if (quiet) {
+                        ++numQuiet;
+                    }
+                    else {
+                        if (numQuiet >= framesToClose)
+                            restarts.push_back (frame);
+                        numQuiet = 0;
+                    }
+                }
+            }
+
+            std::sort (restarts.begin(), restarts.end());
+            return restarts;
+        }
+
+        //the segments at indices, side by side
+        void renderSegments (const std::vector<size_t>& indices)
+        {
+            const int numThreads = std::min ((int)indices.size(), getNumThreads (options));
+            std::atomic<size_t> next { 0 };
+            auto renderNext = [this, &indices, &next] {
+                for (size_t index = next++; index < indices.size(); index = next++)
+                    renderSegment (segments[indices[index]]);
+            };
+
+            std::vector<std::thread> threads;
+            for (int thread = 1; thread < numThreads; ++thread)
+                threads.emplace_back (renderNext);
+            renderNext();
+            for (auto& thread : threads)
+                thread.join();
+        }
+
+        //the serial render's block loop from segment.begin, on the thread calling it
+        void renderSegment (Segment& segment) const
+        {
+            HarmonizerEngine engine;
+            if (fftFactory)
+                engine.setFFTFactory (fftFactory);
+            engine.prepare (config);
+            std::unique_ptr<PitchDetector> detector = setup (engine);
+            engine.setPitchDetector (detector.get());
+
+            const int numChannels = config.numChannels;
+            const int blockSize = config.maxBlockSize;
+            std::vector<std::vector<float>> input (numChannels, std::vector<float> (blockSize, 0.0f));
+            std::vector<std::vector<float>> output (numChannels, std::vector<float> (blockSize, 0.0f));
+            std::vector<const float*> inputPointers (numChannels);
+            std::vector<float*> outputPointers (numChannels);
+            segment.tail.assign (numChannels, std::vector<float> (segment.end - segment.nextCut, 0.0f));
+
+            size_t nextEvent = 0;
+            for (int start = segment.begin; start < segment.end; start += blockSize) {
+                const int length = std::min (blockSize, segment.end - start);
+
+                while (nextEvent < notes.size() && notes[nextEvent].sample <= start)
+                    engine.setPlayedNote (notes[nextEvent++].note);
+
+                for (int channel = 0; channel < numChannels; ++channel) {
+                    for (int sample = 0; sample < length; ++sample) {
+                        const int index = start + sample;
+                        input[channel][sample] = index < numSamples ? inputs[channel][index] : 0.0f;
+                    }
+                    inputPointers[channel] = input[channel].data();
+                    outputPointers[channel] = output[channel].data();
+                }
+
+                engine.process (inputPointers.data(), outputPointers.data(), length);
+
+                //the warm-up is dropped, the owned part goes to the output and the rest to the tail
+                for (int channel = 0; channel < numChannels; ++channel) {
+                    for (int sample = 0; sample < length; ++sample) {
+                        const int position = start + sample;
+                        if (position >= segment.nextCut)
+                            segment.tail[channel][position - segment.nextCut] = output[channel][sample];
+                        else if (position >= segment.cut && position >= latency)
+                            outputs[channel][position - latency] = output[channel][sample];
+                    }
+                }
+            }
+        }
+
+        //how far into the overlap the two start to agree for good, -1 when they do not for at least a frame
+        int findConvergence (const Segment& previous, const Segment& next) const
+        {
+            const int overlapLength = previous.end - next.cut;
+            int converged = 0;
+            for (int channel = 0; channel < config.numChannels; ++channel)
+                for (int sample = overlapLength - 1; sample >= converged; --sample)
+                    if (std::abs (previous.tail[channel][sample] - outputs[channel][next.cut + sample - latency]) > options.joinTolerance) {
+                        converged = sample + 1;
+                        break;
+                    }
+
+            return converged + config.fftSize <= overlapLength ? converged : -1;
+        }
+
+        //replaces the start of next with the tail of previous up to where they converged
+        void join (const Segment& previous, const Segment& next) const
+        {
+            const int converged = std::max (0, findConvergence (previous, next));
+            for (int channel = 0; channel < config.numChannels; ++channel)
+                std::copy (previous.tail[channel].begin(), previous.tail[channel].begin() + converged,
+                           outputs[channel] + next.cut - latency);
+        }
+    };
+};
@@ -0,0 +1,278 @@
+/*
+  ==============================================================================
+
+    SessionBenchmark.h
+    Author:  Sami S
+
+    How many instances fit on this machine. Creates sessions of N processors
+    with fft sizes and block sizes cycled across them, holds a note on each
+    and drives them from a simulated host callback, either all on the
+    callback thread or spread over a pool of worker threads that pick up
+    instances as they become free, the way hosts run tracks in parallel.
+    Reports per session size and thread count the dsp load, the p99 and
+    worst callback time against the callback period, the callbacks that
+    missed it, how many instances would fit at this load and the speed up
+    over one thread, plus resident memory per instance. Shared tables,
+    cache contention or locks between instances show up as poor scaling.
+
+    The console target prints the table with harmonizer --session-benchmark,
+    see CommandLineMain.cpp. Run it on an otherwise idle machine, since
+    anything else playing skews the load column.
+
+  ==============================================================================
+*/
+#pragma once
+
+#include <atomic>
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "BenchmarkHelpers.h"
+
+#if JUCE_LINUX
+ #include <unistd.h>
+#elif JUCE_MAC
+ #include <mach/mach.h>
+#endif
+
+struct SessionBenchmark
+{
+    struct Options
+    {
+        double sampleRate = 48000.0;
+        int hostBlockSize = 512;
+        //simulated audio per run, after a warm up of a tenth of it
+        double seconds = 1.0;
+        Array<int> instanceCounts { 1, 10, 25, 50, 100 };
+        //empty runs on one thread and on every physical core
+        Array<int> threadCounts;
+        //cycled across the instances of a session
+        Array<int> fftSizes { 512, 1024, 2048 };
+        //each instance processes the host block in pieces of its own block size
+        Array<int> blockSizes { 128, 256, 512 };
+    };
+
+    using InstanceFactory = std::function<AudioProcessor*()>;
+
+    static String run (const InstanceFactory& createInstance)
+    {
+        return run (createInstance, Options());
+    }
+
+    static String run (const InstanceFactory& createInstance, const Options& options)
+    {
+        Array<int> threadCounts = options.threadCounts;
+        if (threadCounts.isEmpty()) {
+            threadCounts.add (1);
+            if (SystemStats::getNumPhysicalCpus() > 1)
+                threadCounts.add (SystemStats::getNumPhysicalCpus());
+        }
+
+        const double period = options.hostBlockSize / options.sampleRate;
+        String report = "Session benchmark: " + String (options.hostBlockSize) + " samples at " + String (options.sampleRate)
+                      + " Hz, callback period " + String (period * 1000.0, 2) + " ms, "
+                      + String (SystemStats::getNumPhysicalCpus()) + " cores\n";
+        report << String ("instances").paddedRight (' ', 11) << String ("threads").paddedRight (' ', 9)
+               << String ("MB each").paddedRight (' ', 9) << String ("load %").paddedRight (' ', 9)
+               << String ("p99 ms").paddedRight (' ', 9) << String ("max ms").paddedRight (' ', 9)
+               << String ("missed").paddedRight (' ', 8) << String ("fit").paddedRight (' ', 8) << "speed up\n";
+
+        //every instance reads it from its own offset
+        const AudioBuffer<float> signal = BenchmarkHelpers::createSungVowel (1, options.sampleRate);
+
+        for (int numInstances : options.instanceCounts) {
+            const int64 residentBefore = getResidentBytes();
+            OwnedArray<Instance> instances;
+            for (int index = 0; index < numInstances; ++index)
+                instances.add (new Instance (createInstance(), options, index));
+
+            //touch every buffer once, so what the first callbacks allocate is counted too
+            for (auto* instance : instances)
+                instance->render (signal, options.hostBlockSize);
+            const int64 residentAfter = getResidentBytes();
+            const String megabytesEach = residentBefore > 0 && residentAfter > 0
+                                       ? String ((residentAfter - residentBefore) / (1024.0 * 1024.0) / numInstances, 2)
+                                       : String ("n/a");
+
+            double singleThreadFit = 0.0;
+            for (int numThreads : threadCounts) {
+                const Run result = runSession (instances, signal, options, jmin (numThreads, numInstances));
+                const double fit = result.load > 0.0 ? numInstances / result.load : 0.0;
+                if (numThreads == threadCounts.getFirst())
+                    singleThreadFit = fit;
+
+                report << String (numInstances).paddedRight (' ', 11) << String (numThreads).paddedRight (' ', 9)
+                       << megabytesEach.paddedRight (' ', 9) << String (result.load * 100.0, 1).paddedRight (' ', 9)
+                       << String (result.p99 * 1000.0, 3).paddedRight (' ', 9) << String (result.worst * 1000.0, 3).paddedRight (' ', 9)
+                       << String (result.numMissed).paddedRight (' ', 8) << String ((int)fit).paddedRight (' ', 8)
+                       << String (singleThreadFit > 0.0 ? fit / singleThreadFit : 0.0, 2) << "x\n";
+            }
+
+            for (auto* instance : instances)
+                instance->processor->releaseResources();
+        }
+
+        return report;
+    }
+
+    //0 where it cannot be read
+    static int64 getResidentBytes()
+    {
+       #if JUCE_LINUX
+        StringArray fields;
+        fields.addTokens (File ("/proc/self/statm").loadFileAsString(), " ", "");
+        return fields.size() > 1 ? fields[1].getLargeIntValue() * (int64)sysconf (_SC_PAGESIZE) : 0;
+       #elif JUCE_MAC
+        mach_task_basic_info_data_t info;
+        mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+        if (task_info (mach_task_self(), MACH_TASK_BASIC_INFO, (task_info_t)&info, &count) != KERN_SUCCESS)
+            return 0;
+        return (int64)info.resident_size;
+       #else
+        return 0;
+       #endif
+    }
+
+private:
+    struct Instance
+    {
+        Instance (AudioProcessor* newProcessor, const Options& options, int index)
+            : processor (newProcessor),
+              blockSize (options.blockSizes[index % options.blockSizes.size()]),
+              buffer (2, options.hostBlockSize),
+              position (index * 997)
+        {
+            const int fftSize = options.fftSizes[index % options.fftSizes.size()];
+            //a governor stepping quality down would make a bigger session look cheaper per instance
+            BenchmarkHelpers::setParameter (*processor, "cpugovernor", 0.0f);
+            BenchmarkHelpers::setParameter (*processor, "fftsize", (float)(std::log2 (fftSize) - 5));
+
+            processor->setPlayConfigDetails (2, 2, options.sampleRate, blockSize);
+            processor->prepareToPlay (options.sampleRate, blockSize);
+            midi.ensureSize (256);
+            midi.addEvent (MidiMessage::noteOn (1, 64 + index % 5, (uint8)100), 0);
+        }
+
+        //one host callback, split into the instance's own block size
+        void render (const AudioBuffer<float>& signal, int hostBlockSize)
+        {
+            const int signalLength = signal.getNumSamples();
+            for (int start = 0; start < hostBlockSize; start += blockSize) {
+                const int length = jmin (blockSize, hostBlockSize - start);
+                for (int channel = 0; channel < 2; ++channel) {
+                    float* data = buffer.getWritePointer (channel);
+                    for (int sample = 0; sample < length; ++sample)
+                        data[sample] = signal.getSample (0, (position + sample) % signalLength);
+                }
+                position = (position + length) % signalLength;
+
+                AudioBuffer<float> block (buffer.getArrayOfWritePointers(), 2, length);
+                processor->processBlock (block, midi);
+                //the note stays held from the first block on
+                midi.clear();
+            }
+        }
+
+        std::unique_ptr<AudioProcessor> processor;
+        const int blockSize;
+        AudioBuffer<float> buffer;
+        MidiBuffer midi;
+        int position;
+    };
+
+    //workers that render instances until every one of the callback is done
+    class Worker : public Thread
+    {
+    public:
+        Worker (const OwnedArray<Instance>& sessionInstances, const AudioBuffer<float>& sessionSignal, int sessionBlockSize,
+                std::atomic<int>& sharedNext, std::atomic<int>& sharedDone)
+            : Thread ("Session benchmark worker"), instances (sessionInstances), signal (sessionSignal),
+              hostBlockSize (sessionBlockSize), next (sharedNext), done (sharedDone)
+        {
+        }
+
+        void run() override
+        {
+            while (!threadShouldExit()) {
+                if (!start.wait (100.0))
+                    continue;
+                renderInstances (instances, signal, hostBlockSize, next, done);
+            }
+        }
+
+        WaitableEvent start;
+
+    private:
+        const OwnedArray<Instance>& instances;
+        const AudioBuffer<float>& signal;
+        const int hostBlockSize;
+        std::atomic<int>& next;
+        std::atomic<int>& done;
+    };
+
+    static void renderInstances (const OwnedArray<Instance>& instances, const AudioBuffer<float>& signal, int hostBlockSize,
+                                 std::atomic<int>& next, std::atomic<int>& done)
+    {
+        for (int index = next++; index < instances.size(); index = next++) {
+            instances[index]->render (signal, hostBlockSize);
+            ++done;
+        }
+    }
+
+    struct Run
+    {
+        //callback time over callback period, summed over the run
+        double load = 0.0;
+        double p99 = 0.0;
+        double worst = 0.0;
+        int numMissed = 0;
+    };
+
+    static Run runSession (const OwnedArray<Instance>& instances, const AudioBuffer<float>& signal, const Options& options, int numThreads)
+    {
+        const double period = options.hostBlockSize / options.sampleRate;
+        const int numCallbacks = jmax (1, (int)(options.seconds / period));
+        const int numWarmUpCallbacks = numCallbacks / 10;
+
+        //the callback thread renders too, like a host's audio thread does
+        std::atomic<int> next { 0 }, done { 0 };
+        OwnedArray<Worker> workers;
+        for (int index = 1; index < numThreads; ++index) {
+            workers.add (new Worker (instances, signal, options.hostBlockSize, next, done));
+            workers.getLast()->startThread (Thread::Priority::highest);
+        }
+
+        Array<double> callbackTimes;
+        callbackTimes.ensureStorageAllocated (numCallbacks);
+
+        for (int callback = 0; callback < numWarmUpCallbacks + numCallbacks; ++callback) {
+            const int64 startTicks = Time::getHighResolutionTicks();
+
+            //done first, a worker still leaving the last callback only sees next once it is reset
+            done = 0;
+            next = 0;
+            for (auto* worker : workers)
+                worker->start.signal();
+            renderInstances (instances, signal, options.hostBlockSize, next, done);
+            while (done.load() < instances.size())
+                Thread::yield();
+
+            if (callback >= numWarmUpCallbacks)
+                callbackTimes.add (Time::highResolutionTicksToSeconds (Time::getHighResolutionTicks() - startTicks));
+        }
+
+        for (auto* worker : workers)
+            worker->stopThread (1000);
+
+        Run result;
+        for (double time : callbackTimes) {
+            result.load += time;
+            if (time > period)
+                ++result.numMissed;
+        }
+        result.load /= callbackTimes.size() * period;
+
+        callbackTimes.sort();
+        result.p99 = callbackTimes[jmin (callbackTimes.size() - 1, (int)(callbackTimes.size() * 0.99))];
+        result.worst = callbackTimes.getLast();
+        return result;
+    }
+};
@@ -0,0 +1,147 @@
+/*
+  ==============================================================================
+
+    SharedTables.h
+    Author:  Sami S
+
+    Read-only tables of the phase vocoder (analysis window, its square root,
+    bin frequencies, overlap-add scale factor and fft twiddles), shared by
+    every instance in the process that runs the same fft size, window type
+    and overlap. Tables are built and looked up under a lock from the
+    parameter callbacks or prepareToPlay, never from the audio thread. The
+    audio thread only reads through the pointer its engine holds. The cache
+    only keeps weak references, so tables go away with their last user.
+    Plain C++, part of the DSP core.
+
+  ==============================================================================
+*/
+#pragma once
+
+#include <cmath>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "StockhamFFT.h"
+
+class SharedTables
+{
+public:
+    using Ptr = std::shared_ptr<const SharedTables>;
+
+    //same order as the processor's windowTypeItemsUI
+    enum WindowType {
+        windowBartlett = 0,
+        windowHann,
+        windowHamming,
+    };
+
+    //not realtime safe, may build the tables
+    static Ptr get (int fftSize, int windowType, int overlap)
+    {
+        auto& cache = getCache();
+        const std::lock_guard<std::mutex> sl (cache.lock);
+
+        for (int index = (int)cache.tables.size(); --index >= 0;) {
+            Ptr tables = cache.tables[index].lock();
+            if (tables == nullptr) {
+                cache.tables.erase (cache.tables.begin() + index);
+                continue;
+            }
+
+            if (tables->fftSize == fftSize && tables->windowType == windowType && tables->overlap == overlap)
+                return tables;
+        }
+
+        Ptr tables (new SharedTables (fftSize, windowType, overlap));
+        cache.tables.push_back (tables);
+        return tables;
+    }
+
+    //number of distinct tables alive in the process
+    static int getNumCached()
+    {
+        auto& cache = getCache();
+        const std::lock_guard<std::mutex> sl (cache.lock);
+
+        int numAlive = 0;
+        for (auto& tables : cache.tables)
+            if (!tables.expired())
+                ++numAlive;
+        return numAlive;
+    }
+
+    static void fillWindow (float* window, int windowLength, int windowType)
+    {
+        switch (windowType) {
+            case windowBartlett: {
+                for (int sample = 0; sample < windowLength; ++sample)
+                    window[sample] = 1.0f - fabs (2.0f * (float)sample / (float)(windowLength - 1) - 1.0f);
+                break;
+            }
+            case windowHann: {
+                for (int sample = 0; sample < windowLength; ++sample)
+                    window[sample] = 0.5f - 0.5f * cosf (2.0f * pi * (float)sample / (float)(windowLength - 1));
+                break;
+            }
+            case windowHamming: {
+                for (int sample = 0; sample < windowLength; ++sample)
+                    window[sample] = 0.54f - 0.46f * cosf (2.0f * pi * (float)sample / (float)(windowLength - 1));
+                break;
+            }
+        }
+    }
+
+    const int fftSize;
+    const int windowType;
+    const int overlap;
+
+    std::vector<float> window;
+    //analysis frames are weighted by the square root of the window
+    std::vector<float> sqrtWindow;
+    //bin centre frequencies in radians per sample
+    std::vector<float> omega;
+    float windowScaleFactor = 0.0f;
+    //only used by the vendored fft backend, the juce one keeps its own tables
+    std::shared_ptr<const StockhamFFT::Twiddles> fftTwiddles;
+
+    SharedTables (const SharedTables&) = delete;
+    SharedTables& operator= (const SharedTables&) = delete;
+
+private:
+    SharedTables (int size, int type, int newOverlap)
+        : fftSize (size), windowType (type), overlap (newOverlap)
+    {
+        window.assign (fftSize, 0.0f);
+        fillWindow (window.data(), fftSize, windowType);
+
+        sqrtWindow.assign (fftSize, 0.0f);
+        for (int index = 0; index < fftSize; ++index)
+            sqrtWindow[index] = sqrtf (window[index]);
+
+        omega.assign (fftSize, 0.0f);
+        for (int index = 0; index < fftSize; ++index)
+            omega[index] = 2.0f * pi * index / (float)fftSize;
+
+        float windowSum = 0.0f;
+        for (int sample = 0; sample < fftSize; ++sample)
+            windowSum += window[sample];
+        if (overlap != 0 && windowSum != 0.0f)
+            windowScaleFactor = 1.0f / (float)overlap / windowSum * (float)fftSize;
+
+        fftTwiddles = StockhamFFT::createTwiddles ((int)std::log2 (fftSize));
+    }
+
+    struct Cache
+    {
+        std::mutex lock;
+        std::vector<std::weak_ptr<const SharedTables>> tables;
+    };
+
+    static Cache& getCache()
+    {
+        static Cache cache;
+        return cache;
+    }
+
+    static constexpr double pi = 3.14159265358979323846;
+};
@@ -0,0 +1,181 @@
+/*
+  ==============================================================================
+
+    SpectralPitchDetector.h
+    Author:  Sami S
+
+    Pitch from the phase vocoder's own analysis frames. The bin loop already
+    computes each bin's phase advance over a hop, i.e. its instantaneous
+    frequency, so the only extra work is a harmonic sieve over the spectral
+    peaks. Nothing is computed from raw samples, the engine hands over
+    every analysis frame of channel 0 instead.
+
+  ==============================================================================
+*/
+#pragma once
+
+#include "PitchDetector.h"
+
+class SpectralPitchDetector : public PitchDetector
+{
+public:
+    void prepare (double newSampleRate, int /*blockSize*/) override
+    {
+        sampleRate = newSampleRate;
+        latest = { 0.0f, 0.0f };
+    }
+
+    //the frames come from analyseFrame
+    void pushSamples (const float* /*data*/, int /*numSamples*/) override
+    {
+    }
+
+    PitchEstimate getPitch() override
+    {
+        return latest;
+    }
+
+    //fraction of the peak magnitude the winning harmonic series has to explain
+    void setThreshold (float newThreshold) override
+    {
+        minConfidence = 0.9f - 2.0f * newThreshold;
+    }
+
+    bool usesAnalysisFrames() const override
+    {
+        return true;
+    }
+
+    void analyseFrame (const float* magnitudes, const float* phaseAdvances, int fftSize, int hopSize) override
+    {
+        const int numBins = fftSize / 2;
+        const float twoPi = 6.283185307f;
+        const float binToFrequency = (float)sampleRate / (twoPi * (float)hopSize);
+
+        float maxMagnitude = 0.0f;
+        for (int bin = 1; bin < numBins; ++bin)
+            maxMagnitude = std::max (maxMagnitude, magnitudes[bin]);
+        if (maxMagnitude <= 0.0f) {
+            latest = { 0.0f, 0.0f };
+            return;
+        }
+
+        //strongest local maxima with their instantaneous frequency
+        numPeaks = 0;
+        for (int bin = 1; bin < numBins - 1; ++bin) {
+            const float magnitude = magnitudes[bin];
+            if (magnitude <= magnitudes[bin - 1] || magnitude < magnitudes[bin + 1] || magnitude < peakFloor * maxMagnitude)
+                continue;
+
+            const float frequency = phaseAdvances[bin] * binToFrequency;
+            if (frequency < minFrequency || frequency > maxPartialFrequency)
+                continue;
+
+            if (numPeaks < maxNumPeaks) {
+                peaks[numPeaks++] = { frequency, magnitude };
+            }
+            else {
+                int weakest = 0;
+                for (int peak = 1; peak < numPeaks; ++peak)
+                    if (peaks[peak].magnitude < peaks[weakest].magnitude)
+                        weakest = peak;
+                if (magnitude > peaks[weakest].magnitude)
+                    peaks[weakest] = { frequency, magnitude };
+            }
+        }
+
+        if (numPeaks == 0) {
+            latest = { 0.0f, 0.0f };
+            return;
+        }
+
+        float totalMagnitude = 0.0f;
+        for (int peak = 0; peak < numPeaks; ++peak)
+            totalMagnitude += peaks[peak].magnitude;
+
+        //every peak divided by a small integer is a candidate, scored by the peaks its harmonics explain.
+        //weighting by 1 / sqrt (harmonic) stops subharmonics from winning with the same peaks
+        float bestFrequency = 0.0f;
+        float bestScore = 0.0f;
+        for (int peak = 0; peak < numPeaks; ++peak) {
+            for (int divisor = 1; divisor <= maxDivisor; ++divisor) {
+                const float candidate = peaks[peak].frequency / (float)divisor;
+                if (candidate < minFrequency || candidate > maxFrequency)
+                    continue;
+
+                const float score = harmonicScore (candidate, nullptr, nullptr);
+                if (score > bestScore) {
+                    bestScore = score;
+                    bestFrequency = candidate;
+                }
+            }
+        }
+
+        if (bestFrequency <= 0.0f) {
+            latest = { 0.0f, 0.0f };
+            return;
+        }
+
+        //refine with the magnitude weighted fundamental implied by each matched partial
+        float explainedMagnitude = 0.0f;
+        float refinedFrequency = bestFrequency;
+        harmonicScore (bestFrequency, &refinedFrequency, &explainedMagnitude);
+
+        const float confidence = explainedMagnitude / totalMagnitude;
+        if (confidence < minConfidence)
+            latest = { 0.0f, confidence };
+        else
+            latest = { refinedFrequency, confidence };
+    }
+
+private:
+    struct Peak
+    {
+        float frequency;
+        float magnitude;
+    };
+
+    float harmonicScore (float fundamental, float* refinedFrequency, float* explainedMagnitude) const
+    {
+        float score = 0.0f, matched = 0.0f, weightedFundamental = 0.0f;
+
+        for (int peak = 0; peak < numPeaks; ++peak) {
+            const float harmonic = std::round (peaks[peak].frequency / fundamental);
+            if (harmonic < 1.0f || harmonic > (float)maxHarmonic)
+                continue;
+            if (std::abs (peaks[peak].frequency - harmonic * fundamental) > harmonicTolerance * fundamental)
+                continue;
+
+            score += peaks[peak].magnitude / std::sqrt (harmonic);
+            matched += peaks[peak].magnitude;
+            weightedFundamental += peaks[peak].magnitude * peaks[peak].frequency / harmonic;
+        }
+
+        if (refinedFrequency != nullptr && matched > 0.0f)
+            *refinedFrequency = weightedFundamental / matched;
+        if (explainedMagnitude != nullptr)
+            *explainedMagnitude = matched;
+        return score;
+    }
+
+    enum {
+        maxNumPeaks = 24,
+        maxDivisor = 4,
+        maxHarmonic = 16,
+    };
+
+    static constexpr float minFrequency = 60.0f;
+    static constexpr float maxFrequency = 1100.0f;
+    static constexpr float maxPartialFrequency = 5000.0f;
+    //-40 dB below the strongest bin
+    static constexpr float peakFloor = 0.01f;
+    //fraction of the fundamental a partial can be away from its harmonic
+    static constexpr float harmonicTolerance = 0.1f;
+
+    double sampleRate = 44100.0;
+    float minConfidence = 0.7f;
+
+    Peak peaks[maxNumPeaks];
+    int numPeaks = 0;
+    PitchEstimate latest { 0.0f, 0.0f };
+};
@@ -0,0 +1,140 @@
+/*
+  ==============================================================================
+
+    StartupBenchmark.h
+    Author:  Sami S
+
+    What loading a session costs. Loads sessions of N instances the way a
+    host opens a project: constructs every processor, restores the same
+    saved state (a non-default fft size, hop and tracker, so the restore
+    has something to rebuild) and prepares them all. Reports per session
+    size how long each of the three steps took in total, the resident
+    memory per instance once prepared, and how far the peak resident memory
+    rose above it during the load. Work done before prepareToPlay shows up
+    in the first two columns, allocations freed again in the peak.
+
+    The console target prints the table with harmonizer --startup-benchmark,
+    see CommandLineMain.cpp. The peak column only moves past what the
+    process already reached, so it is run there in a process of its own.
+
+  ==============================================================================
+*/
+#pragma once
+
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "BenchmarkHelpers.h"
+#include "SessionBenchmark.h"
+
+#if JUCE_LINUX || JUCE_MAC
+ #include <sys/resource.h>
+#endif
+
+struct StartupBenchmark
+{
+    struct Options
+    {
+        double sampleRate = 48000.0;
+        int blockSize = 512;
+        Array<int> instanceCounts { 1, 10, 50, 100 };
+    };
+
+    using InstanceFactory = SessionBenchmark::InstanceFactory;
+
+    static String run (const InstanceFactory& createInstance)
+    {
+        return run (createInstance, Options());
+    }
+
+    static String run (const InstanceFactory& createInstance, const Options& options)
+    {
+        const MemoryBlock savedState = getSavedState (createInstance);
+
+        String report = "Startup benchmark: " + String (options.blockSize) + " samples at " + String (options.sampleRate) + " Hz\n";
+        report << String ("instances").paddedRight (' ', 11) << String ("create ms").paddedRight (' ', 11)
+               << String ("restore ms").paddedRight (' ', 12) << String ("prepare ms").paddedRight (' ', 12)
+               << String ("load ms").paddedRight (' ', 9) << String ("MB each").paddedRight (' ', 9) << "peak MB\n";
+
+        for (int numInstances : options.instanceCounts) {
+            const int64 residentBefore = SessionBenchmark::getResidentBytes();
+            const int64 peakBefore = getPeakResidentBytes();
+            OwnedArray<AudioProcessor> instances;
+
+            const int64 startTicks = Time::getHighResolutionTicks();
+            for (int index = 0; index < numInstances; ++index)
+                instances.add (createInstance());
+            const int64 createdTicks = Time::getHighResolutionTicks();
+
+            for (auto* instance : instances)
+                instance->setStateInformation (savedState.getData(), (int)savedState.getSize());
+            const int64 restoredTicks = Time::getHighResolutionTicks();
+
+            for (auto* instance : instances) {
+                instance->setPlayConfigDetails (2, 2, options.sampleRate, options.blockSize);
+                instance->prepareToPlay (options.sampleRate, options.blockSize);
+            }
+            const int64 preparedTicks = Time::getHighResolutionTicks();
+
+            const int64 residentAfter = SessionBenchmark::getResidentBytes();
+            const int64 peakAfter = getPeakResidentBytes();
+            const bool hasResident = residentBefore > 0 && residentAfter > 0;
+            //the peak only moves when this load went higher than anything before it
+            const bool hasPeak = hasResident && peakBefore > 0 && peakAfter > jmax (peakBefore, residentAfter);
+
+            report << String (numInstances).paddedRight (' ', 11)
+                   << String (ticksToMs (createdTicks - startTicks), 1).paddedRight (' ', 11)
+                   << String (ticksToMs (restoredTicks - createdTicks), 1).paddedRight (' ', 12)
+                   << String (ticksToMs (preparedTicks - restoredTicks), 1).paddedRight (' ', 12)
+                   << String (ticksToMs (preparedTicks - startTicks), 1).paddedRight (' ', 9)
+                   << (hasResident ? String ((residentAfter - residentBefore) / (1024.0 * 1024.0) / numInstances, 2) : String ("n/a")).paddedRight (' ', 9)
+                   << (hasPeak ? String ((peakAfter - residentAfter) / (1024.0 * 1024.0), 1) : String ("-")) << "\n";
+
+            for (auto* instance : instances)
+                instance->releaseResources();
+        }
+
+        return report;
+    }
+
+    //0 where it cannot be read
+    static int64 getPeakResidentBytes()
+    {
+       #if JUCE_LINUX || JUCE_MAC
+        struct rusage usage;
+        if (getrusage (RUSAGE_SELF, &usage) != 0)
+            return 0;
+        #if JUCE_MAC
+         return (int64)usage.ru_maxrss;
+        #else
+         return (int64)usage.ru_maxrss * 1024;
+        #endif
+       #else
+        return 0;
+       #endif
+    }
+
+private:
+    //a state as a host would have saved it, from an instance set up away from the defaults
+    static MemoryBlock getSavedState (const InstanceFactory& createInstance)
+    {
+        std::unique_ptr<AudioProcessor> processor (createInstance());
+        const std::pair<const char*, float> values[] = {
+            { "fftsize", 6.0f },
+            { "hopsize", 1.0f },
+            { "windowtype", 2.0f },
+            { "pitchtracker", 1.0f },
+            { "preserveformants", 1.0f },
+        };
+
+        for (auto& value : values)
+            BenchmarkHelpers::setParameter (*processor, value.first, value.second);
+
+        MemoryBlock state;
+        processor->getStateInformation (state);
+        return state;
+    }
+
+    static double ticksToMs (int64 ticks)
+    {
+        return Time::highResolutionTicksToSeconds (ticks) * 1000.0;
+    }
+};
@@ -0,0 +1,318 @@
+/*
+  ==============================================================================
+
+    StockhamFFT.h
+    Author:  Sami S
+
+    Self-contained power of two FFT for platforms where juce::dsp::FFT falls
+    back to its generic radix implementation (no IPP, no vDSP). It is a
+    Stockham autosort FFT [1]: radix 4 stages plus one radix 2 stage for odd
+    orders, ping-ponging between two buffers, so there is no bit reversal
+    pass. Data is kept as split real and imaginary arrays and each butterfly
+    loop runs over contiguous samples with precomputed twiddles, which lets
+    the compiler vectorise it. Real transforms go through a half size complex
+    transform. The twiddles never change after construction, so instances
+    of the same size can share them. Plain C++ so it can be shared with
+    non-JUCE code.
+
+    [1]: Van Loan, C. (1992). Computational Frameworks for the Fast Fourier
+            Transform. SIAM.
+
+  ==============================================================================
+*/
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <memory>
+#include <vector>
+
+class StockhamFFT
+{
+public:
+    //read-only tables of one size
+    struct Twiddles
+    {
+        int order = 0;
+        //twiddles of every radix 4 stage back to back (w, w^2, w^3 for each butterfly)
+        std::vector<float> fullRe, fullIm;
+        std::vector<float> halfRe, halfIm;
+        //post-processing twiddles of the real transforms, e^(-2 pi i k / size)
+        std::vector<float> realRe, realIm;
+    };
+
+    static std::shared_ptr<const Twiddles> createTwiddles (int order)
+    {
+        auto twiddles = std::make_shared<Twiddles>();
+        twiddles->order = order;
+
+        const int size = 1 << order;
+        const int complexSize = order > 0 ? size / 2 : 1;
+        fillStageTwiddles (twiddles->fullRe, twiddles->fullIm, size);
+        fillStageTwiddles (twiddles->halfRe, twiddles->halfIm, complexSize);
+
+        for (int k = 0; k <= complexSize; ++k) {
+            twiddles->realRe.push_back ((float)std::cos (twoPi * k / size));
+            twiddles->realIm.push_back ((float)-std::sin (twoPi * k / size));
+        }
+
+        return twiddles;
+    }
+
+    explicit StockhamFFT (int order)
+        : StockhamFFT (createTwiddles (order))
+    {
+    }
+
+    explicit StockhamFFT (std::shared_ptr<const Twiddles> sharedTwiddles)
+        : twiddles (std::move (sharedTwiddles)),
+          size (1 << twiddles->order), complexSize (twiddles->order > 0 ? size / 2 : 1)
+    {
+        prepare (full, size, twiddles->fullRe, twiddles->fullIm);
+        prepare (half, complexSize, twiddles->halfRe, twiddles->halfIm);
+        realTwiddleRe = twiddles->realRe.data();
+        realTwiddleIm = twiddles->realIm.data();
+
+        scratchRe.resize (complexSize + 1);
+        scratchIm.resize (complexSize + 1);
+    }
+
+    int getSize() const noexcept { return size; }
+
+    //out of place or in place, inverse is scaled by 1 / size like juce::dsp::FFT
+    void perform (const std::complex<float>* input, std::complex<float>* output, bool inverse)
+    {
+        for (int i = 0; i < size; ++i) {
+            full.re[i] = input[i].real();
+            full.im[i] = input[i].imag();
+        }
+
+        const float* re;
+        const float* im;
+        transform (full, inverse, re, im);
+
+        const float scale = inverse ? 1.0f / (float)size : 1.0f;
+        for (int i = 0; i < size; ++i)
+            output[i] = { re[i] * scale, im[i] * scale };
+    }
+
+    //same layout as juce::dsp::FFT: size reals in, size interleaved complex bins out (2 * size floats)
+    void performRealOnlyForwardTransform (float* data)
+    {
+        if (size == 1) {
+            data[1] = 0.0f;
+            return;
+        }
+
+        //even samples as real, odd samples as imaginary part of a half size signal
+        for (int i = 0; i < complexSize; ++i) {
+            half.re[i] = data[2 * i];
+            half.im[i] = data[2 * i + 1];
+        }
+
+        const float* re;
+        const float* im;
+        transform (half, false, re, im);
+
+        //X[k] = E[k] + W^k O[k], with E and O split from Z[k] and conj (Z[n / 2 - k])
+        for (int k = 0; k <= complexSize; ++k) {
+            const int k1 = k == complexSize ? 0 : k;
+            const int k2 = k == 0 ? 0 : complexSize - k;
+
+            const float evenRe = 0.5f * (re[k1] + re[k2]);
+            const float evenIm = 0.5f * (im[k1] - im[k2]);
+            const float oddRe = 0.5f * (im[k1] + im[k2]);
+            const float oddIm = -0.5f * (re[k1] - re[k2]);
+
+            const float wRe = realTwiddleRe[k], wIm = realTwiddleIm[k];
+            scratchRe[k] = evenRe + wRe * oddRe - wIm * oddIm;
+            scratchIm[k] = evenIm + wRe * oddIm + wIm * oddRe;
+        }
+
+        for (int k = 0; k <= complexSize; ++k) {
+            data[2 * k] = scratchRe[k];
+            data[2 * k + 1] = scratchIm[k];
+        }
+
+        //negative frequencies are the mirrored conjugates
+        for (int k = complexSize + 1; k < size; ++k) {
+            data[2 * k] = data[2 * (size - k)];
+            data[2 * k + 1] = -data[2 * (size - k) + 1];
+        }
+    }
+
+    //inverse of the above, bins up to size / 2 are read and size reals are written, scaled by 1 / size
+    void performRealOnlyInverseTransform (float* data)
+    {
+        if (size == 1)
+            return;
+
+        //E[k] and O[k] back from X[k] and conj (X[n / 2 - k]), packed as Z[k] = E[k] + i O[k]
+        for (int k = 0; k < complexSize; ++k) {
+            const int k2 = complexSize - k;
+            const float aRe = data[2 * k], aIm = data[2 * k + 1];
+            const float bRe = data[2 * k2], bIm = -data[2 * k2 + 1];
+
+            const float evenRe = 0.5f * (aRe + bRe);
+            const float evenIm = 0.5f * (aIm + bIm);
+            const float diffRe = 0.5f * (aRe - bRe);
+            const float diffIm = 0.5f * (aIm - bIm);
+
+            //O[k] = (X[k] - conj (X[n / 2 - k])) / (2 W^k)
+            const float wRe = realTwiddleRe[k], wIm = -realTwiddleIm[k];
+            const float oddRe = diffRe * wRe - diffIm * wIm;
+            const float oddIm = diffRe * wIm + diffIm * wRe;
+
+            half.re[k] = evenRe - oddIm;
+            half.im[k] = evenIm + oddRe;
+        }
+
+        const float* re;
+        const float* im;
+        transform (half, true, re, im);
+
+        const float scale = 1.0f / (float)complexSize;
+        for (int i = 0; i < complexSize; ++i) {
+            data[2 * i] = re[i] * scale;
+            data[2 * i + 1] = im[i] * scale;
+        }
+    }
+
+private:
+    //per instance work buffers of one transform size
+    struct Plan
+    {
+        int size = 1;
+        const float* twiddleRe = nullptr;
+        const float* twiddleIm = nullptr;
+        std::vector<float> re, im, workRe, workIm;
+    };
+
+    static void fillStageTwiddles (std::vector<float>& twiddleRe, std::vector<float>& twiddleIm, int n)
+    {
+        for (int length = n; length >= 4; length /= 4) {
+            const int quarter = length / 4;
+            for (int p = 0; p < quarter; ++p) {
+                for (int power = 1; power <= 3; ++power) {
+                    twiddleRe.push_back ((float)std::cos (twoPi * power * p / length));
+                    twiddleIm.push_back ((float)-std::sin (twoPi * power * p / length));
+                }
+            }
+        }
+    }
+
+    static void prepare (Plan& plan, int n, const std::vector<float>& twiddleRe, const std::vector<float>& twiddleIm)
+    {
+        plan.size = n;
+        plan.twiddleRe = twiddleRe.data();
+        plan.twiddleIm = twiddleIm.data();
+        plan.re.assign (n, 0.0f);
+        plan.im.assign (n, 0.0f);
+        plan.workRe.assign (n, 0.0f);
+        plan.workIm.assign (n, 0.0f);
+    }
+
+    //runs on plan.re / plan.im, the result ends up in either pair of buffers
+    static void transform (Plan& plan, bool inverse, const float*& outRe, const float*& outIm)
+    {
+        float* xRe = plan.re.data();
+        float* xIm = plan.im.data();
+        float* yRe = plan.workRe.data();
+        float* yIm = plan.workIm.data();
+
+        //the inverse uses conjugate twiddles and rotates by +i instead of -i
+        const float sign = inverse ? -1.0f : 1.0f;
+        const float* twRe = plan.twiddleRe;
+        const float* twIm = plan.twiddleIm;
+
+        int length = plan.size;
+        int stride = 1;
+
+        while (length >= 4) {
+            const int quarter = length / 4;
+
+            for (int p = 0; p < quarter; ++p) {
+                const float w1Re = twRe[3 * p],     w1Im = sign * twIm[3 * p];
+                const float w2Re = twRe[3 * p + 1], w2Im = sign * twIm[3 * p + 1];
+                const float w3Re = twRe[3 * p + 2], w3Im = sign * twIm[3 * p + 2];
+
+                const float* aRe = xRe + stride * p;
+                const float* aIm = xIm + stride * p;
+                const float* bRe = aRe + stride * quarter;
+                const float* bIm = aIm + stride * quarter;
+                const float* cRe = bRe + stride * quarter;
+                const float* cIm = bIm + stride * quarter;
+                const float* dRe = cRe + stride * quarter;
+                const float* dIm = cIm + stride * quarter;
+
+                float* y0Re = yRe + stride * 4 * p;
+                float* y0Im = yIm + stride * 4 * p;
+                float* y1Re = y0Re + stride;
+                float* y1Im = y0Im + stride;
+                float* y2Re = y1Re + stride;
+                float* y2Im = y1Im + stride;
+                float* y3Re = y2Re + stride;
+                float* y3Im = y2Im + stride;
+
+                for (int q = 0; q < stride; ++q) {
+                    const float sumAcRe = aRe[q] + cRe[q], sumAcIm = aIm[q] + cIm[q];
+                    const float diffAcRe = aRe[q] - cRe[q], diffAcIm = aIm[q] - cIm[q];
+                    const float sumBdRe = bRe[q] + dRe[q], sumBdIm = bIm[q] + dIm[q];
+                    //-i (b - d) forward, +i (b - d) inverse
+                    const float rotBdRe = sign * (bIm[q] - dIm[q]);
+                    const float rotBdIm = -sign * (bRe[q] - dRe[q]);
+
+                    y0Re[q] = sumAcRe + sumBdRe;
+                    y0Im[q] = sumAcIm + sumBdIm;
+
+                    const float x1Re = diffAcRe + rotBdRe, x1Im = diffAcIm + rotBdIm;
+                    y1Re[q] = x1Re * w1Re - x1Im * w1Im;
+                    y1Im[q] = x1Re * w1Im + x1Im * w1Re;
+
+                    const float x2Re = sumAcRe - sumBdRe, x2Im = sumAcIm - sumBdIm;
+                    y2Re[q] = x2Re * w2Re - x2Im * w2Im;
+                    y2Im[q] = x2Re * w2Im + x2Im * w2Re;
+
+                    const float x3Re = diffAcRe - rotBdRe, x3Im = diffAcIm - rotBdIm;
+                    y3Re[q] = x3Re * w3Re - x3Im * w3Im;
+                    y3Im[q] = x3Re * w3Im + x3Im * w3Re;
+                }
+            }
+
+            twRe += 3 * quarter;
+            twIm += 3 * quarter;
+            length /= 4;
+            stride *= 4;
+            std::swap (xRe, yRe);
+            std::swap (xIm, yIm);
+        }
+
+        //odd orders end with a twiddle-free radix 2 stage
+        if (length == 2) {
+            for (int q = 0; q < stride; ++q) {
+                const float aRe = xRe[q], aIm = xIm[q];
+                const float bRe = xRe[q + stride], bIm = xIm[q + stride];
+                yRe[q] = aRe + bRe;
+                yIm[q] = aIm + bIm;
+                yRe[q + stride] = aRe - bRe;
+                yIm[q + stride] = aIm - bIm;
+            }
+            std::swap (xRe, yRe);
+            std::swap (xIm, yIm);
+        }
+
+        outRe = xRe;
+        outIm = xIm;
+    }
+
+    static constexpr double twoPi = 6.283185307179586;
+
+    std::shared_ptr<const Twiddles> twiddles;
+    int size;
+    int complexSize;
+    Plan full, half;
+    const float* realTwiddleRe;
+    const float* realTwiddleIm;
+    std::vector<float> scratchRe, scratchIm;
+};
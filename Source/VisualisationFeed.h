@@ -0,0 +1,180 @@
+/*
+  ==============================================================================
+
+    VisualisationFeed.h
+    Author:  Sami S
+
+    What the editor draws, handed over from the audio thread without locks:
+    the channel 0 spectrum decimated to log spaced bands, and what the voice
+    logic made of every block (tracked frequency, midiVoice, midiPlayed,
+    ratio). Both go through single producer single consumer fifos. The audio
+    thread drops what does not fit, the editor drains them on a timer, so
+    neither side ever waits on the other. The processor only feeds it while
+    an editor is open.
+
+  ==============================================================================
+*/
+#pragma once
+
+#include <atomic>
+#include "../JuceLibraryCode/JuceHeader.h"
+#include "HarmonizerEngine.h"
+
+class VisualisationFeed : public HarmonizerEngine::FrameObserver
+{
+public:
+    enum {
+        numBands = 96,
+        //spectra per second at most, the editor repaints slower than that anyway
+        spectrumRate = 60,
+        spectrumFifoSize = 8,
+        trackFifoSize = 512,
+    };
+
+    //levels in dB of bands from minFrequency up to nyquist
+    struct Spectrum
+    {
+        float levels[numBands];
+    };
+
+    struct TrackPoint
+    {
+        float frequency;
+        int midiVoice;
+        int midiPlayed;
+        float ratio;
+        bool passThrough;
+    };
+
+    VisualisationFeed() : spectrumFifo (spectrumFifoSize), trackFifo (trackFifoSize)
+    {
+    }
+
+    //message thread, the editor switches it on for its lifetime. what was left from an editor opened
+    //before is dropped first, the reader may do that while the audio thread is not writing
+    void setActive (bool shouldBeActive)
+    {
+        if (shouldBeActive) {
+            spectrumFifo.finishedRead (spectrumFifo.getNumReady());
+            trackFifo.finishedRead (trackFifo.getNumReady());
+        }
+
+        active.store (shouldBeActive);
+    }
+
+    bool isActive() const
+    {
+        return active.load();
+    }
+
+    //called with the processor lock held, like the audio thread
+    void setSampleRate (double newSampleRate)
+    {
+        sampleRate = newSampleRate;
+        bandsFftSize = 0;
+    }
+
+    //audio thread
+    void frameAnalysed (const float* magnitudes, int fftSize, int hopSize) override
+    {
+        samplesSinceSpectrum += hopSize;
+        if (samplesSinceSpectrum < (int)(sampleRate / spectrumRate))
+            return;
+        samplesSinceSpectrum = 0;
+
+        if (fftSize != bandsFftSize)
+            updateBands (fftSize);
+
+        int start1, size1, start2, size2;
+        spectrumFifo.prepareToWrite (1, start1, size1, start2, size2);
+        if (size1 == 0)
+            return;
+
+        //a full scale sine through the square root hann window peaks at about fftSize / pi
+        const float scale = MathConstants<float>::pi / (float)fftSize;
+        Spectrum& spectrum = spectra[start1];
+        for (int band = 0; band < numBands; ++band) {
+            float peak = 0.0f;
+            for (int bin = bandStarts[band]; bin < bandStarts[band + 1]; ++bin)
+                peak = jmax (peak, magnitudes[bin]);
+            spectrum.levels[band] = Decibels::gainToDecibels (peak * scale, minLevel);
+        }
+
+        spectrumFifo.finishedWrite (1);
+    }
+
+    //audio thread, once per block
+    void pushTrackingState (const HarmonizerEngine::TrackingState& state)
+    {
+        int start1, size1, start2, size2;
+        trackFifo.prepareToWrite (1, start1, size1, start2, size2);
+        if (size1 == 0)
+            return;
+
+        trackPoints[start1] = { state.frequency, state.midiVoice, state.midiPlayed, state.ratio, state.passThrough };
+        trackFifo.finishedWrite (1);
+    }
+
+    //message thread: drains the fifo into the latest spectrum, false when nothing new came in
+    bool popLatestSpectrum (Spectrum& latest)
+    {
+        const int numReady = spectrumFifo.getNumReady();
+        if (numReady == 0)
+            return false;
+
+        int start1, size1, start2, size2;
+        spectrumFifo.prepareToRead (numReady, start1, size1, start2, size2);
+        latest = spectra[size2 > 0 ? start2 + size2 - 1 : start1 + size1 - 1];
+        spectrumFifo.finishedRead (size1 + size2);
+        return true;
+    }
+
+    //message thread: calls function for every point pushed since the last call, oldest first
+    template <typename Function>
+    void popTrackPoints (Function&& function)
+    {
+        int start1, size1, start2, size2;
+        trackFifo.prepareToRead (trackFifo.getNumReady(), start1, size1, start2, size2);
+        for (int index = 0; index < size1; ++index)
+            function (trackPoints[start1 + index]);
+        for (int index = 0; index < size2; ++index)
+            function (trackPoints[start2 + index]);
+        trackFifo.finishedRead (size1 + size2);
+    }
+
+    static constexpr float minFrequency = 40.0f;
+    static constexpr float minLevel = -96.0f;
+
+private:
+    //no allocation, so it can run on the audio thread when the fft size changes
+    void updateBands (int fftSize)
+    {
+        const float nyquist = (float)sampleRate * 0.5f;
+        for (int band = 0; band <= numBands; ++band) {
+            const float frequency = minFrequency * std::pow (nyquist / minFrequency, (float)band / numBands);
+            bandStarts[band] = jlimit (1, fftSize / 2, roundToInt (frequency * fftSize / sampleRate));
+        }
+
+        //bands narrower than a bin still read one
+        for (int band = 0; band < numBands; ++band)
+            bandStarts[band + 1] = jmax (bandStarts[band + 1], jmin (fftSize / 2, bandStarts[band] + 1));
+
+        bandsFftSize = fftSize;
+    }
+
+    std::atomic<bool> active { false };
+
+    //audio thread side
+    double sampleRate = 44100.0;
+    int samplesSinceSpectrum = 0;
+    int bandsFftSize = 0;
+    int bandStarts[numBands + 1] = {};
+
+    AbstractFifo spectrumFifo;
+    Spectrum spectra[spectrumFifoSize];
+
+    AbstractFifo trackFifo;
+    TrackPoint trackPoints[trackFifoSize];
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (VisualisationFeed)
+};
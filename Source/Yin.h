@@ -14,7 +14,11 @@
 */
 #pragma once
 
-#include <JuceHeader.h>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include "HalfBandDecimator.h"
+#include "PitchDetector.h"
 
 class YIN 
 {
@@ -24,19 +28,42 @@ public:
 
     void yinPrepare(int sampleRate, int size) 
     {
-        bufferSize = size;
-        yin.setSize(1, size);
-        yin.clear();
+        //track at 44.1 or 48 kHz whatever the host rate is, so vocal periods cover the same number of lags
+        decimator.prepare(HalfBandDecimator::getNumStages(sampleRate, 44100.0));
+        decimationFactor = decimator.getFactor();
+
+        bufferSize = std::max((int)minBufferSize, size / decimationFactor);
+        yin.assign(bufferSize, 0.0f);
+
+        //the difference function reads up to twice the window
+        history.assign(2 * bufferSize, 0.0f);
+        decimated.assign(size, 0.0f);
+
+        //full rate history for refining the decimated period
+        fullRateHistory.assign(decimationFactor > 1 ? 2 * bufferSize * decimationFactor + 2 * decimationFactor : 0, 0.0f);
+
         isPrepared = true;
         //DBG("sampleRate: " << sampleRate << "| size: " << yin.getNumSamples());
     }
 
-    float yinPitch(const float* inputData, double sampleRate)
+    float yinPitch(const float* inputData, int numSamples, double sampleRate)
+    {
+        yinPush(inputData, numSamples);
+        return yinPitch(sampleRate);
+    }
+
+    //pitch of the latest pushed window
+    float yinPitch(double sampleRate)
     {
         float pitch = 0.0f;
-        pitch = calculatePitch(inputData);
+        pitch = calculatePitch(history.data());
         //DBG("DF MIN: " << pitch);
 
+        if (pitch > 0 && decimationFactor > 1)
+        {
+            pitch = refinePeriod(pitch * decimationFactor);
+        }
+
         if (pitch > 0)
         {
             pitch = sampleRate / (pitch + 0.0);
@@ -62,7 +89,7 @@ public:
     float calculatePitch(const float* inputData)
     {
         //read only mono data from channel 0
-        float* yinData = yin.getWritePointer(0);
+        float* yinData = yin.data();
         float difference = 0.0f;
         float sum = 0.0f;
 
@@ -70,22 +97,23 @@ public:
         {
             //difference
             yinData[0] = 1.0f;
+            yinData[tau] = 0.0f;
             for (int i = 0; i < bufferSize; i++)
             {
-                difference += inputData[i] - inputData[i + tau];
+                difference = inputData[i] - inputData[i + tau];
                 yinData[tau] += (difference * difference);
             }
 
-            //normalize
+            //normalize by the cumulative mean
+            sum += yinData[tau];
             if (sum != 0)
             {
-                sum += yinData[tau];
+                yinData[tau] = yinData[tau] * tau / (sum);
             }
             else
             {
-                sum = 1.0;
+                yinData[tau] = 1.0f;
             }
-            yinData[tau] = yinData[tau] * tau / (sum);
 
             int period = tau - 3;
 
@@ -95,9 +123,13 @@ public:
                 (yinData[period] < yinData[period + 1]))
             {
                 //DBG("return early");
-                return quadraticPeakPosition(yin.getReadPointer(0), period);
+                //a dip only counts below the threshold, so 1 - d' would never go under 1 - threshold. scaled by
+                //the threshold, a breathy dip just under it is as unsure as it sounds
+                confidence = std::min(1.0f, std::max(0.0f, 1.0f - yinData[period] / threshold));
+                return quadraticPeakPosition(yin.data(), period);
             }
         }
+        confidence = 0.0f;
         return -1.0f;
     }
 
@@ -140,18 +172,136 @@ public:
         return pos;
     }
 
+    //the decimated minimum is only accurate to a decimated sample, search the full rate difference function around it
+    float refinePeriod(float coarsePeriod)
+    {
+        const float* data = fullRateHistory.data();
+        const int windowSize = bufferSize * decimationFactor;
+        const int maxPeriod = (int)fullRateHistory.size() - windowSize - 1;
+        const int first = std::min(maxPeriod, std::max(1, (int)coarsePeriod - decimationFactor));
+        const int numPeriods = std::min({(int)maxRefinePeriods, maxPeriod - first + 1, 2 * decimationFactor + 2});
+
+        float differences[maxRefinePeriods];
+        int pos = 0;
+        for (int i = 0; i < numPeriods; i++)
+        {
+            differences[i] = difference(data, windowSize, first + i);
+            pos = (differences[pos] <= differences[i]) ? pos : i;
+        }
+
+        //same parabola as quadraticPeakPosition, minima on the search edge are returned as they are
+        if (pos == 0 || pos == numPeriods - 1) return (float)(first + pos);
+
+        const float s0 = differences[pos - 1], s1 = differences[pos], s2 = differences[pos + 1];
+        if (s0 - 2.0f * s1 + s2 == 0.0f) return (float)(first + pos);
+        return first + pos + 0.5f * (s0 - s2) / (s0 - 2.0f * s1 + s2);
+    }
+
     //function to be called by the parameters...
     void yinUpdateThreshold(float newThreshold)
     {
         threshold = newThreshold;
-        yin.clear();
+        std::fill(yin.begin(), yin.end(), 0.0f);
     }
 
   
     bool isPrepared = false;
     int bufferSize = 1024;
-    juce::AudioSampleBuffer yin;
+    int decimationFactor = 1;
+    std::vector<float> yin;
     float threshold = 0.15f;
+    //1 - the normalised difference at the chosen period, 0 when no period was found
+    float confidence = 0.0f;
+
+    //keep the latest 2 * bufferSize decimated samples (and their full rate source) in linear buffers
+    void yinPush(const float* inputData, int numSamples)
+    {
+        shiftIn(fullRateHistory, inputData, numSamples);
+
+        while (numSamples > 0)
+        {
+            const int numToDecimate = std::min(numSamples, (int)decimated.size());
+            const int numDecimated = decimator.process(inputData, decimated.data(), numToDecimate);
+            shiftIn(history, decimated.data(), numDecimated);
+
+            inputData += numToDecimate;
+            numSamples -= numToDecimate;
+        }
+    }
 
 private:  
+    enum { minBufferSize = 64, maxRefinePeriods = 32 };
+
+    static void shiftIn(std::vector<float>& buffer, const float* inputData, int numSamples)
+    {
+        const int length = (int)buffer.size();
+        if (length == 0) return;
+
+        float* data = buffer.data();
+        if (numSamples >= length)
+        {
+            std::copy(inputData + numSamples - length, inputData + numSamples, data);
+            return;
+        }
+
+        std::copy(data + numSamples, data + length, data);
+        std::copy(inputData, inputData + numSamples, data + length - numSamples);
+    }
+
+    static float difference(const float* data, int windowSize, int tau)
+    {
+        float sum = 0.0f;
+        for (int i = 0; i < windowSize; i++)
+        {
+            const float delta = data[i] - data[i + tau];
+            sum += delta * delta;
+        }
+        return sum;
+    }
+
+    HalfBandDecimator decimator;
+    std::vector<float> history;
+    std::vector<float> decimated;
+    std::vector<float> fullRateHistory;
+};
+
+//YIN behind the common pitch tracker interface
+class YinPitchDetector : public PitchDetector
+{
+public:
+    void prepare(double newSampleRate, int blockSize) override
+    {
+        sampleRate = newSampleRate;
+        yin.yinPrepare((int)sampleRate, blockSize);
+        latest = { 0.0f, 0.0f };
+        hasNewSamples = false;
+    }
+
+    void pushSamples(const float* data, int numSamples) override
+    {
+        yin.yinPush(data, numSamples);
+        hasNewSamples = true;
+    }
+
+    PitchEstimate getPitch() override
+    {
+        if (hasNewSamples)
+        {
+            const float frequency = yin.yinPitch(sampleRate);
+            latest = { frequency, yin.confidence };
+            hasNewSamples = false;
+        }
+        return latest;
+    }
+
+    void setThreshold(float newThreshold) override
+    {
+        yin.yinUpdateThreshold(newThreshold);
+    }
+
+private:
+    YIN yin;
+    double sampleRate = 44100.0;
+    PitchEstimate latest { 0.0f, 0.0f };
+    bool hasNewSamples = false;
 };